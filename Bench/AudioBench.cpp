@@ -0,0 +1,72 @@
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "Benchmark.h"
+#include "Nes.h"
+#include "NullSink.h"
+#include "RingBufferSink.h"
+
+// Sinks call a plain function, so the nes being pulled from is kept here
+static Nes* audioNes = nullptr;
+static std::atomic<int64_t> synthTotalNs = 0;
+static std::atomic<int64_t> synthBlocks = 0;
+
+static void Synth(float* outBlock)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (!audioNes->GetSamples(outBlock))
+		std::fill(outBlock, outBlock + AudioSink::SAMPLES_PER_BLOCK, 0.0f);
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	synthTotalNs += (int64_t)elapsed.count();
+	synthBlocks++;
+}
+
+void BenchAudio(const BenchOptions& options)
+{
+	auto nes = BootRom("audio", options, 300);
+	if (!nes)
+		return;
+	nes->rewindBudget = 0;
+	audioNes = nes.get();
+
+	// What producing audio costs a frame, with a null sink pulling the
+	// samples at the device rate as a sound card would
+	double silentNs = TimeNs(60, [&] { nes->DoIteration(); });
+	double audibleNs;
+	{
+		NullSink sink(Synth);
+		nes->headless = false;
+		audibleNs = TimeNs(60, [&] { nes->DoIteration(); });
+	}
+	PrintComparison("audio", "us/frame", "silent", silentNs / 1000.0, "audible", audibleNs / 1000.0);
+	if (synthBlocks > 0)
+		std::cout << "audio: " << synthTotalNs / synthBlocks / 1000.0 << " us per block pulled by the sink" << std::endl;
+
+	// One second played in real time into a ring sink, to check that the
+	// audio keeps up without gaps or dropped blocks
+	constexpr int FRAMES = 60;
+	std::vector<Sample> captured(AudioSink::DEFAULT_SAMPLE_RATE * 2);
+	size_t count = 0;
+	size_t dropped = 0;
+	{
+		RingBufferSink sink(Synth);
+		auto next = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < FRAMES; frame++)
+		{
+			nes->DoIteration();
+			count += sink.Read(captured.data() + count, captured.size() - count);
+			next += std::chrono::microseconds(1000000 / FRAMES);
+			std::this_thread::sleep_until(next);
+		}
+		count += sink.Read(captured.data() + count, captured.size() - count);
+		dropped = sink.GetDroppedBlocks();
+	}
+	audioNes = nullptr;
+
+	int peak = 0;
+	for (size_t i = 0; i < count; i++)
+		peak = std::max(peak, std::abs((int)captured[i]));
+	std::cout << "audio: " << count << " samples captured in " << FRAMES << " frames, peak "
+		<< peak << ", " << dropped << " blocks dropped" << std::endl;
+}
@@ -0,0 +1,30 @@
+#include "Benchmark.h"
+#include "Nes.h"
+
+std::unique_ptr<Nes> BootRom(const char* bench, const BenchOptions& options, int frames, const std::wstring& sramPath)
+{
+	if (options.romFilename.empty())
+	{
+		std::cout << bench << ": skipped, needs a rom (-r <file.nes>)" << std::endl;
+		return nullptr;
+	}
+
+	// Named the way Nes names the save when it loads a state
+	const auto& rom = options.romFilename;
+	std::wstring cartSRamPath = sramPath.empty() ? L"" : sramPath + rom.substr(rom.find_last_of(L"/\\") + 1) + L".sram";
+	auto nes = std::make_unique<Nes>(sramPath);
+	nes->InsertCartridge(std::make_shared<Cartridge>(cartSRamPath, rom));
+	nes->headless = true;
+
+	// Start is pressed now and then, with other buttons in between. The
+	// nes keeps reading these, released, once it is returned.
+	static uint8_t buttons[2] = {};
+	nes->SetInputSource(buttons);
+	for (int frame = 0; frame < frames; frame++)
+	{
+		buttons[0] = frame % 60 < 5 ? 0x08 : (uint8_t)(frame * 37);
+		nes->ClockFrame();
+	}
+	buttons[0] = 0;
+	return nes;
+}
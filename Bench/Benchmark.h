@@ -0,0 +1,62 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+class Nes;
+
+struct BenchOptions
+{
+	// Rom for the benchmarks that run a game
+	std::wstring romFilename;
+};
+
+// Results are added here so that the work being timed is never optimised away
+inline volatile uint64_t benchSink = 0;
+
+// Runs fn the given number of times per round and returns the time per
+// call in nanoseconds of the fastest round. The fastest round is the one
+// least disturbed by the rest of the system.
+template<typename F>
+double TimeNs(int iterations, F&& fn, int rounds = 5)
+{
+	using namespace std::chrono;
+	double best = 0.0;
+	for (int round = 0; round < rounds; round++)
+	{
+		auto start = steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+			fn();
+		duration<double, std::nano> elapsed = steady_clock::now() - start;
+		double ns = elapsed.count() / iterations;
+		if (round == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+// Prints one line comparing a change against what it replaced
+inline void PrintComparison(const char* name, const char* unit, const char* beforeLabel, double before, const char* afterLabel, double after)
+{
+	std::cout << std::fixed << std::setprecision(2)
+		<< name << ": "
+		<< beforeLabel << " " << before << " " << unit << ", "
+		<< afterLabel << " " << after << " " << unit
+		<< " (" << before / after << "x)" << std::endl;
+}
+
+// Starts the rom headless and runs it for the given number of frames with
+// changing input, so that the state is past the title screen. Battery
+// saves go under sramPath, or nowhere if it is empty. Returns null and
+// says so if no rom was given.
+std::unique_ptr<Nes> BootRom(const char* bench, const BenchOptions& options, int frames, const std::wstring& sramPath = L"");
+
+void BenchMixing(const BenchOptions& options);
+void BenchFilter(const BenchOptions& options);
+void BenchSaveState(const BenchOptions& options);
+void BenchFork(const BenchOptions& options);
+void BenchAudio(const BenchOptions& options);
@@ -0,0 +1,63 @@
+#include <filesystem>
+#include "Benchmark.h"
+#include "Nes.h"
+
+void BenchFork(const BenchOptions& options)
+{
+	// The original keeps a battery save in a scratch directory so that
+	// forks can be checked to leave it alone
+	auto sramDir = std::filesystem::temp_directory_path() / "NesBench";
+	std::filesystem::create_directories(sramDir);
+	auto nes = BootRom("fork", options, 600, sramDir.wstring() + L"/");
+	if (!nes)
+	{
+		std::filesystem::remove_all(sramDir);
+		return;
+	}
+
+	// Before forks, a copy was a savestate loaded into a new machine
+	auto CopyThroughState = [&]
+	{
+		auto copy = std::make_unique<Nes>(L"");
+		copy->headless = true;
+		copy->LoadState(options.romFilename, nes->SaveState());
+		return copy;
+	};
+
+	double stateNs = TimeNs(500, [&]
+	{
+		benchSink += (uint64_t)CopyThroughState().get();
+	});
+	double forkNs = TimeNs(500, [&]
+	{
+		benchSink += (uint64_t)nes->Fork().get();
+	});
+	PrintComparison("fork", "us/copy", "savestate", stateNs / 1000.0, "fork", forkNs / 1000.0);
+
+	// A fork pays for the pages it writes, so the copies also run a frame
+	// as a search would
+	double stateFrameNs = TimeNs(100, [&]
+	{
+		auto copy = CopyThroughState();
+		copy->ClockFrame();
+	});
+	double forkFrameNs = TimeNs(100, [&]
+	{
+		auto copy = nes->Fork();
+		copy->ClockFrame();
+	});
+	PrintComparison("fork", "us/copy and frame", "savestate", stateFrameNs / 1000.0, "fork", forkFrameNs / 1000.0);
+
+	// A fork must never journal, even once a state has loaded a new
+	// cartridge into it, or it would write over the original's save
+	auto fork = nes->Fork();
+	fork->RemoveCartridge();
+	fork->LoadState(options.romFilename, nes->SaveState());
+	fork->ClockFrame();
+	fork->SaveSRam();
+	if (fork->IsJournalingSRam())
+		std::cout << "fork: error, a fork opened an sram journal" << std::endl;
+	fork.reset();
+	nes.reset();
+	std::filesystem::remove_all(sramDir);
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "EmuFileException.h"
+
+// Pixels are never drawn without a window
+void DrawPixel(int x, int y, uint8_t c)
+{
+}
+
+struct BenchEntry
+{
+	const wchar_t* name;
+	void(*run)(const BenchOptions& options);
+};
+
+static const BenchEntry BENCHMARKS[] =
+{
+	{ L"mixing", BenchMixing },
+	{ L"filter", BenchFilter },
+	{ L"savestate", BenchSaveState },
+	{ L"fork", BenchFork },
+	{ L"audio", BenchAudio },
+};
+
+static void PrintUsage()
+{
+	std::wcout <<
+		L"usage: Bench [options] [benchmark...]\n"
+		L"  -r <file.nes>  rom for the benchmarks that run a game\n"
+		L"  benchmarks:";
+	for (const auto& bench : BENCHMARKS)
+		std::wcout << L" " << bench.name;
+	std::wcout << std::endl;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	// Runs the named benchmarks, or all of them
+	BenchOptions options;
+	std::vector<std::wstring> selected;
+	for (int i = 1; i < argc; i++)
+	{
+		std::wstring arg = argv[i];
+		bool found = false;
+		for (const auto& bench : BENCHMARKS)
+			found |= arg == bench.name;
+
+		if (arg == L"-r" && i + 1 < argc)
+			options.romFilename = argv[++i];
+		else if (found)
+			selected.push_back(arg);
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	try
+	{
+		for (const auto& bench : BENCHMARKS)
+			if (selected.empty() || std::find(selected.begin(), selected.end(), bench.name) != selected.end())
+				bench.run(options);
+	}
+	catch (EmuFileException& e)
+	{
+		std::cout << "error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include <random>
+#include <vector>
+#include "Apu.h"
+#include "Benchmark.h"
+
+// The float mixer that Apu used before mixing moved to fixed point, kept
+// as the baseline. Volumes were float multipliers and the tables were
+// function local statics.
+static float MixFloat(const uint8_t* values, const float* volumes)
+{
+	size_t pulse1 =   static_cast<size_t>(values[0] * volumes[0]);
+	size_t pulse2 =   static_cast<size_t>(values[1] * volumes[1]);
+	size_t triangle = static_cast<size_t>(values[2] * volumes[2]);
+	size_t noise =    static_cast<size_t>(values[3] * volumes[3]);
+	size_t dmc =      static_cast<size_t>(0.0f);
+
+	static std::vector<float> pulseTable = []
+	{
+		std::vector<float> res;
+		res.push_back(0.0f);
+		for (size_t i = 1; i < 31; ++i)
+			res.push_back(95.52f / (8128.0f / i + 100.0f));
+		return res;
+	}();
+	static std::vector<float> tndTable = []
+	{
+		std::vector<float> res;
+		res.push_back(0.0f);
+		for (size_t i = 1; i < 203; ++i)
+			res.push_back(163.67f / (24329.0f / i + 100.0f));
+		return res;
+	}();
+	return pulseTable[pulse1 + pulse2] + tndTable[3 * triangle + 2 * noise + dmc];
+}
+
+void BenchMixing(const BenchOptions& options)
+{
+	// Random 4 bit outputs stand in for the four channels
+	constexpr int SAMPLES = 4096;
+	std::vector<uint8_t> values(SAMPLES * 4);
+	std::mt19937 rng(1);
+	for (auto& value : values)
+		value = (uint8_t)(rng() & 15);
+
+	const float volumes[4] = { 1.0f, 0.75f, 1.0f, 0.5f };
+	ChannelLevels levels[4];
+	for (int i = 0; i < 4; i++)
+		levels[i] = MakeChannelLevels(volumes[i]);
+
+	double floatNs = TimeNs(2000, [&]
+	{
+		float sum = 0.0f;
+		for (int i = 0; i < SAMPLES; i++)
+			sum += MixFloat(&values[i * 4], volumes);
+		benchSink += (uint64_t)sum;
+	}) / SAMPLES;
+
+	double fixedNs = TimeNs(2000, [&]
+	{
+		int sum = 0;
+		for (int i = 0; i < SAMPLES; i++)
+		{
+			const uint8_t* v = &values[i * 4];
+			sum += Apu::MixChannels(levels[0][v[0]], levels[1][v[1]], levels[2][v[2]], levels[3][v[3]], 0);
+		}
+		benchSink += (uint64_t)sum;
+	}) / SAMPLES;
+
+	PrintComparison("mixing", "ns/sample", "float", floatNs, "fixed point", fixedNs);
+}
@@ -0,0 +1,31 @@
+#include "Benchmark.h"
+#include "Nes.h"
+
+void BenchSaveState(const BenchOptions& options)
+{
+	auto nes = BootRom("savestate", options, 600);
+	if (!nes)
+		return;
+
+	// Saving reuses one buffer, as the rewind and run-ahead captures do
+	Snapshot state;
+	double saveNs = TimeNs(2000, [&]
+	{
+		state.clear();
+		StateWriter bytes(state);
+		nes->SaveState(bytes);
+		benchSink += state.size();
+	});
+
+	// Loading the same rom's state restores in place
+	double loadNs = TimeNs(2000, [&]
+	{
+		nes->LoadState(options.romFilename, state);
+	});
+
+	double mb = state.size() / 1e6;
+	std::cout << std::fixed << std::setprecision(2)
+		<< "savestate: " << state.size() << " bytes, save "
+		<< saveNs / 1000.0 << " us (" << mb / (saveNs / 1e9) << " MB/s), load "
+		<< loadNs / 1000.0 << " us (" << mb / (loadNs / 1e9) << " MB/s)" << std::endl;
+}
@@ -1,54 +1,123 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <memory>
-#include <mutex>
+#include <type_traits>
 #include <vector>
-#include "Audio.h"
+#include "AudioFilterChain.h"
+#include "AudioSink.h"
+#include "ApuChannels.h"
+#include "Ppu.h"
 #include "SaveStateUtil.h"
+#include "SpscRing.h"
 
-class FrameCounter;
-class PulseChannel;
-class TriangleChannel;
-class NoiseChannel;
 class Nes;
+class StemRecorder;
 
 class Apu
 {
 public:
 	enum class Channel { Pulse1, Pulse2, Triangle, Noise };
 	Apu(Nes& nes);
-	Apu(Nes& nes, Snapshot& bytes);
-	Snapshot SaveState() const;
+	void LoadState(StateReader& bytes);
+	void SaveState(StateWriter& bytes) const;
+	uint64_t HashState(uint64_t hash) const;
 	void Reset();
 	void Clock();
 	uint8_t ReadFromCpu(uint16_t cpuAddress, bool readonly = false);
 	void WriteFromCpu(uint16_t cpuAddress, uint8_t value);
 	bool GetIrq() const;
 
-	void GetSamples(float* outBuffer);
-	void SetEmulationSpeed(float speed);
+	bool GetSamples(float* outBuffer);
+	// Takes queued samples as they are, for offline rendering where the
+	// caller runs the apu itself. Don't mix with GetSamples.
+	size_t DrainSamples(Sample* out, size_t maxCount);
+	// Same convention as Nes: n > 0 runs n frames per frame, n < 0 runs
+	// one frame every -n frames
+	void SetEmulationSpeed(int speed);
+	void SetSynthesisEnabled(bool enabled);
+	void SetStemRecorder(StemRecorder* recorder);
+	int GetLatencyMs() const;
+	void SetChannelVolume(Channel channel, float volume);
+	float GetChannelVolume(Channel channel) const;
+
+	// Output sample rate shared by every apu, must match the audio device
+	static void SetSampleRate(int rate);
+	static int GetSampleRate();
+	// Mixed samples are Q14 fixed point so the mixer's slight overshoot
+	// past 1.0 still fits in a Sample
+	static constexpr int SAMPLE_ONE = 1 << 14;
+	// Nonlinear mix of channel outputs that already have their volume applied
+	static Sample MixChannels(size_t pulse1, size_t pulse2, size_t triangle, size_t noise, size_t dmc);
+	// Samples are generated at a fixed rate per emulated dot, independent
+	// of emulation speed. Dots per second are doubled so that the half dot
+	// skipped on odd frames keeps the count integral.
+	static constexpr uint32_t DOT_RATE_X2 = (2 * Ppu::DOT_COUNT * Ppu::SCANLINE_COUNT - 1) * 60;
 private:
-	float SampleChannelsAndMix();
-	static constexpr int MAX_QUEUED_AUDIO_BUFFERS = 8;
-	friend class FrameCounter;
+	static constexpr ChannelLevels FULL_VOLUME = MakeChannelLevels(1.0f);
+
+	// Optionally writes each channel's own output to stems
+	Sample SampleChannelsAndMix(Sample* stems = nullptr);
+	void ClockFrameCounterEvents(uint8_t events);
+	// Fits the emulated sample stream to real time for the current speed
+	void QueueSample(Sample sample);
+
+	// Samples are queued in small chunks and resampled on the audio thread
+	// at a ratio nudged by the queue fill, which keeps the queue near its
+	// target without underruns while the frame timer and audio clock drift.
+	// The queue is lock free; the emulation thread produces and the audio
+	// thread consumes.
+	static constexpr int SAMPLES_PER_PUSH = 64;
+	static constexpr int TARGET_QUEUED_SAMPLES = AudioSink::SAMPLES_PER_BLOCK * 3 / 2;
+	static constexpr int MAX_QUEUED_SAMPLES = AudioSink::SAMPLES_PER_BLOCK * 4;
+	static constexpr double MAX_RATIO_ADJUSTMENT = 0.005;
+	static constexpr double FILL_SMOOTHING = 0.05;
+	static std::atomic_int sampleRate;
 
 	Nes& nes;
-	bool enabled = false;
-	bool evenFrame = true;
-	float realTime = 0.0f;
-	float channelVolumes[4];
-	int clockNumber = 0;
-	std::shared_ptr<FrameCounter> frameCounter;
-	std::shared_ptr<PulseChannel> pulseChannel1;
-	std::shared_ptr<PulseChannel> pulseChannel2;
-	std::shared_ptr<TriangleChannel> triangleChannel;
-	std::shared_ptr<NoiseChannel> noiseChannel;
-
-	mutable std::mutex mtx;
-	std::atomic_int buffersFull = 0;
-	std::vector<float> finalAudioBuffer;
-	std::vector<float> audioBuffer;
-	std::atomic<float> emulationSpeed;
 
+	// All emulated APU state lives inline in this block so that it stays contiguous
+	// and can be saved and restored with a single copy
+	struct State
+	{
+		bool enabled = false;
+		bool evenFrame = true;
+		uint8_t clockNumber = 0;
+		uint32_t sampleClock = 0;
+		float channelVolumes[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		ChannelLevels channelLevels[4] = { FULL_VOLUME, FULL_VOLUME, FULL_VOLUME, FULL_VOLUME };
+		FrameCounter frameCounter;
+		PulseChannel pulseChannel1{ 0 };
+		PulseChannel pulseChannel2{ 1 };
+		TriangleChannel triangleChannel;
+		NoiseChannel noiseChannel;
+	} state;
+	static_assert(std::is_trivially_copyable_v<State>, "apu state must be trivially copyable");
+
+	SpscRing<Sample, 4096> queuedSamples;
+	std::vector<Sample> audioBuffer;
+	// Size of audioBuffer, for reading from other threads
+	std::atomic<size_t> stagedSamples = 0;
+	// A block never reads more than is queued, so this is never resized on
+	// the audio thread
+	std::array<Sample, MAX_QUEUED_SAMPLES> resampleInput{};
+	std::atomic_int emulationSpeed = 1;
+
+	// Speed stage, only touched by the emulation thread. Fast forward
+	// averages runs of samples down and slow motion stretches them out.
+	int speedSum = 0;
+	int speedCount = 0;
+	Sample previousSample = 0;
+
+	// When off, the channels are still clocked so that registers and
+	// irqs stay exact, but no samples are mixed or queued
+	bool synthesize = true;
+	StemRecorder* stemRecorder = nullptr;
+
+	// Resampler state, only touched by the audio thread
+	double resamplePhase = 0.0;
+	double averageFill = TARGET_QUEUED_SAMPLES;
+	AudioFilterChain outputFilter{ AudioSink::DEFAULT_SAMPLE_RATE };
 	float lastSample = 0.0f;
 	bool wasStarved = true;
 };
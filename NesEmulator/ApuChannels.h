@@ -0,0 +1,976 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <iterator>
+
+// Building blocks of the APU channels. Every unit below holds plain sized integers
+// and no pointers, so the channels can live inline in Apu and be copied as raw bytes.
+
+#ifdef _DEBUG
+inline void ApuAssert(bool b)
+{
+	if (!b)
+		throw "invalid apu op";
+}
+#else
+#define ApuAssert(b)
+#endif
+
+constexpr uint32_t Bit(unsigned n)
+{
+	return 1u << n;
+}
+
+template <class... Args>
+constexpr uint32_t Bits(unsigned arg, Args... args)
+{
+	return Bits(args...) | Bit(arg);
+}
+
+template <>
+constexpr uint32_t Bits(unsigned int arg)
+{
+	return Bit(arg);
+}
+
+template <typename T, typename U>
+inline void SetBits(T& target, U value)
+{
+	target |= value;
+}
+
+template <typename T, typename U>
+inline void ClearBits(T& target, U value)
+{
+	target &= ~value;
+}
+
+template <typename T, typename U>
+inline T ReadBits(const T& target, U value)
+{
+	return target & value;
+}
+
+template <typename T, typename U>
+inline bool TestBits(const T& target, U value)
+{
+	return ReadBits(target, value) != 0;
+}
+
+class LengthCounter;
+
+// Divider outputs a clock periodically.
+// Note that the term 'period' in this code really means 'period reload value', P,
+// where the actual output clock period is P + 1.
+class Divider
+{
+public:
+	Divider() : m_period(0), m_counter(0) {}
+
+	uint16_t GetPeriod() const { return m_period; }
+	uint16_t GetCounter() const { return m_counter; }
+
+	void SetPeriod(uint16_t period)
+	{
+		m_period = period;
+	}
+
+	void ResetCounter()
+	{
+		m_counter = m_period;
+	}
+
+	bool Clock()
+	{
+		// We count down from P to 0 inclusive, clocking out every P + 1 input clocks.
+		if (m_counter-- == 0)
+		{
+			ResetCounter();
+			return true;
+		}
+		return false;
+	}
+
+private:
+	uint16_t m_period;
+	uint16_t m_counter;
+};
+
+// When LengthCounter reaches 0, corresponding channel is silenced
+// http://wiki.nesdev.com/w/index.php/APU_Length_Counter
+class LengthCounter
+{
+public:
+	LengthCounter() : m_enabled(false), m_halt(false), m_counter(0) {}
+
+	void SetEnabled(bool enabled)
+	{
+		m_enabled = enabled;
+
+		// Disabling resets counter to 0, and it stays that way until enabled again
+		if (!m_enabled)
+			m_counter = 0;
+	}
+
+	void SetHalt(bool halt)
+	{
+		m_halt = halt;
+	}
+
+	void LoadCounterFromLUT(uint8_t index)
+	{
+		if (!m_enabled)
+			return;
+
+		static constexpr uint8_t lut[] =
+		{
+			10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+			12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+		};
+		static_assert(std::size(lut) == 32, "Invalid");
+		ApuAssert(index < std::size(lut));
+
+		m_counter = lut[index];
+	}
+
+	// Clocked by FrameCounter
+	void Clock()
+	{
+		if (m_halt) // Halting locks counter at current value
+			return;
+
+		if (m_counter > 0) // Once it reaches 0, it stops, and channel is silenced
+			--m_counter;
+	}
+
+	uint8_t GetValue() const
+	{
+		return m_counter;
+	}
+
+	bool SilenceChannel() const
+	{
+		return m_counter == 0;
+	}
+
+private:
+	bool m_enabled;
+	bool m_halt;
+	uint8_t m_counter;
+};
+
+// Controls volume in 2 ways: decreasing saw with optional looping, or constant volume
+// Input: Clocked by Frame Sequencer
+// Output: 4-bit volume value (0-15)
+// http://wiki.nesdev.com/w/index.php/APU_Envelope
+class VolumeEnvelope
+{
+public:
+	VolumeEnvelope()
+		: m_restart(true)
+		, m_loop(false)
+		, m_counter(0)
+		, m_constantVolumeMode(false)
+		, m_constantVolume(0)
+	{
+	}
+
+	void Restart() { m_restart = true; }
+	void SetLoop(bool loop) { m_loop = loop; }
+	void SetConstantVolumeMode(bool mode) { m_constantVolumeMode = mode; }
+
+	void SetConstantVolume(uint16_t value)
+	{
+		ApuAssert(value < 16);
+		m_constantVolume = value & 0b1111;
+		m_divider.SetPeriod(m_constantVolume); // Constant volume doubles up as divider reload value
+	}
+
+	uint8_t GetVolume() const
+	{
+		uint8_t result = m_constantVolumeMode ? m_constantVolume : m_counter;
+		ApuAssert(result < 16);
+		return result;
+	}
+
+	// Clocked by FrameCounter
+	void Clock()
+	{
+		if (m_restart)
+		{
+			m_restart = false;
+			m_counter = 15;
+			m_divider.ResetCounter();
+		}
+		else
+		{
+			if (m_divider.Clock())
+			{
+				if (m_counter > 0)
+				{
+					--m_counter;
+				}
+				else if (m_loop)
+				{
+					m_counter = 15;
+				}
+			}
+		}
+	}
+
+private:
+	bool m_restart;
+	bool m_loop;
+	Divider m_divider;
+	uint8_t m_counter; // Saw envelope volume value (if not constant volume mode)
+	bool m_constantVolumeMode;
+	uint8_t m_constantVolume; // Also reload value for divider
+};
+
+// Produces the square wave based on one of 4 duty cycles
+// http://wiki.nesdev.com/w/index.php/APU_Pulse
+class PulseWaveGenerator
+{
+public:
+	PulseWaveGenerator() : m_duty(0), m_step(0) {}
+
+	void Restart()
+	{
+		m_step = 0;
+	}
+
+	void SetDuty(uint8_t duty)
+	{
+		ApuAssert(duty < 4);
+		m_duty = duty;
+	}
+
+	// Clocked by an ApuTimer, outputs bit (0 or 1)
+	void Clock()
+	{
+		m_step = (m_step + 1) % 8;
+	}
+
+	uint8_t GetValue() const
+	{
+		static constexpr uint8_t sequences[4][8] =
+		{
+			{ 0, 1, 0, 0, 0, 0, 0, 0 }, // 12.5%
+			{ 0, 1, 1, 0, 0, 0, 0, 0 }, // 25%
+			{ 0, 1, 1, 1, 1, 0, 0, 0 }, // 50%
+			{ 1, 0, 0, 1, 1, 1, 1, 1 }  // 25% negated
+		};
+
+		const uint8_t value = sequences[m_duty][m_step];
+		return value;
+	}
+
+private:
+	uint8_t m_duty; // 2 bits
+	uint8_t m_step; // 0-7
+};
+
+// A timer is used in each of the five channels to control the sound frequency. It contains a divider which is
+// clocked by the CPU clock. The triangle channel's timer is clocked on every CPU cycle, but the pulse, noise,
+// and DMC timers are clocked only on every second CPU cycle and thus produce only even periods.
+// http://wiki.nesdev.com/w/index.php/APU_Misc#Glossary
+class ApuTimer
+{
+public:
+	ApuTimer() : m_minPeriod(0) {}
+
+	void Reset()
+	{
+		m_divider.ResetCounter();
+	}
+
+	uint16_t GetPeriod() const { return m_divider.GetPeriod(); }
+
+	void SetPeriod(uint16_t period)
+	{
+		m_divider.SetPeriod(period);
+	}
+
+	void SetPeriodLow8(uint8_t value)
+	{
+		uint16_t period = m_divider.GetPeriod();
+		period = (period & Bits(8, 9, 10)) | value; // Keep high 3 bits
+		SetPeriod(period);
+	}
+
+	void SetPeriodHigh3(uint16_t value)
+	{
+		ApuAssert(value < Bit(3));
+		uint16_t period = m_divider.GetPeriod();
+		period = (value << 8) | (period & 0xFF); // Keep low 8 bits
+		m_divider.SetPeriod(period);
+
+		m_divider.ResetCounter();
+	}
+
+	void SetMinPeriod(uint16_t minPeriod)
+	{
+		m_minPeriod = minPeriod;
+	}
+
+	// Clocked by CPU clock every cycle (triangle channel) or second cycle (pulse/noise channels)
+	// Returns true when output chip should be clocked
+	bool Clock()
+	{
+		// Avoid popping and weird noises from ultra sonic frequencies
+		if (m_divider.GetPeriod() < m_minPeriod)
+			return false;
+
+		if (m_divider.Clock())
+		{
+			return true;
+		}
+		return false;
+	}
+
+private:
+	Divider m_divider;
+	uint16_t m_minPeriod;
+};
+
+// Periodically adjusts the period of the ApuTimer, sweeping the frequency high or low over time
+// http://wiki.nesdev.com/w/index.php/APU_Sweep
+class SweepUnit
+{
+public:
+	SweepUnit()
+		: m_subtractExtra(0)
+		, m_enabled(false)
+		, m_negate(false)
+		, m_reload(false)
+		, m_silenceChannel(false)
+		, m_shiftCount(0)
+		, m_targetPeriod(0)
+	{
+	}
+
+	void SetSubtractExtra()
+	{
+		m_subtractExtra = 1;
+	}
+
+	void SetEnabled(bool enabled) { m_enabled = enabled; }
+	void SetNegate(bool negate) { m_negate = negate; }
+
+	void SetPeriod(uint16_t period, ApuTimer& timer)
+	{
+		ApuAssert(period < 8); // 3 bits
+		m_divider.SetPeriod(period); // Don't reset counter
+
+		// From wiki: The adder computes the next target period immediately after the period is updated by $400x writes
+		// or by the frame counter.
+		ComputeTargetPeriod(timer);
+	}
+
+	void SetShiftCount(uint8_t shiftCount)
+	{
+		ApuAssert(shiftCount < Bit(3));
+		m_shiftCount = shiftCount;
+	}
+
+	void Restart() { m_reload = true; }
+
+	// Clocked by FrameCounter
+	void Clock(ApuTimer& timer)
+	{
+		ComputeTargetPeriod(timer);
+
+		if (m_reload)
+		{
+			// From nesdev wiki: "If the divider's counter was zero before the reload and the sweep is enabled,
+			// the pulse's period is also adjusted". What this effectively means is: if the divider would have
+			// clocked and reset as usual, adjust the timer period.
+			if (m_enabled && m_divider.Clock())
+			{
+				AdjustTimerPeriod(timer);
+			}
+
+			m_divider.ResetCounter();
+
+			m_reload = false;
+		}
+		else
+		{
+			// From the nesdev wiki, it looks like the divider is always decremented, but only
+			// reset to its period if the sweep is enabled.
+			if (m_divider.GetCounter() > 0)
+			{
+				m_divider.Clock();
+			}
+			else if (m_enabled && m_divider.Clock())
+			{
+				AdjustTimerPeriod(timer);
+			}
+		}
+	}
+
+	bool SilenceChannel() const
+	{
+		return m_silenceChannel;
+	}
+
+private:
+	void ComputeTargetPeriod(ApuTimer& timer)
+	{
+		ApuAssert(m_shiftCount < 8); // 3 bits
+
+		const uint16_t currPeriod = timer.GetPeriod();
+		const uint16_t shiftedPeriod = currPeriod >> m_shiftCount;
+
+		if (m_negate)
+		{
+			// Pulse 1's adder's carry is hardwired, so the subtraction adds the one's complement
+			// instead of the expected two's complement (as pulse 2 does)
+			m_targetPeriod = currPeriod - (shiftedPeriod - m_subtractExtra);
+		}
+		else
+		{
+			m_targetPeriod = currPeriod + shiftedPeriod;
+		}
+
+		// Channel will be silenced under certain conditions even if Sweep unit is disabled
+		m_silenceChannel = (currPeriod < 8 || m_targetPeriod > 0x7FF);
+	}
+
+	void AdjustTimerPeriod(ApuTimer& timer)
+	{
+		// If channel is not silenced, it means we're in range
+		if (m_enabled && m_shiftCount > 0 && !m_silenceChannel)
+		{
+			timer.SetPeriod(m_targetPeriod);
+		}
+	}
+
+private:
+	uint8_t m_subtractExtra;
+	bool m_enabled;
+	bool m_negate;
+	bool m_reload;
+	bool m_silenceChannel; // This is the Sweep -> Gate connection, if true channel is silenced
+	uint8_t m_shiftCount; // [0,7]
+	Divider m_divider;
+	uint16_t m_targetPeriod; // Target period for the timer; is computed continuously in real hardware
+};
+
+// Maps a channel's 4 bit output to its output after applying a volume,
+// so that volume costs a table lookup when mixing
+using ChannelLevels = std::array<uint8_t, 16>;
+
+constexpr ChannelLevels MakeChannelLevels(float volume)
+{
+	ChannelLevels levels{};
+	for (int i = 0; i < 16; i++)
+	{
+		int level = (int)(i * volume + 0.5f);
+		levels[i] = (uint8_t)(level < 0 ? 0 : level > 15 ? 15 : level);
+	}
+	return levels;
+}
+
+// Concrete base class for audio channels
+class AudioChannel
+{
+public:
+	AudioChannel() = default;
+	LengthCounter& GetLengthCounter() { return m_lengthCounter; }
+
+protected:
+	ApuTimer m_timer;
+	LengthCounter m_lengthCounter;
+};
+
+// http://wiki.nesdev.com/w/index.php/APU_Pulse
+class PulseChannel : public AudioChannel
+{
+public:
+	PulseChannel(uint8_t pulseChannelNumber)
+	{
+		ApuAssert(pulseChannelNumber < 2);
+		if (pulseChannelNumber == 0)
+			m_sweepUnit.SetSubtractExtra();
+	}
+
+	void ClockQuarterFrameChips()
+	{
+		m_volumeEnvelope.Clock();
+	}
+
+	void ClockHalfFrameChips()
+	{
+		m_lengthCounter.Clock();
+		m_sweepUnit.Clock(m_timer);
+	}
+
+	void ClockTimer()
+	{
+		if (m_timer.Clock())
+		{
+			m_pulseWaveGenerator.Clock();
+		}
+	}
+
+	void HandleCpuWrite(uint16_t cpuAddress, uint8_t value)
+	{
+		switch (ReadBits(cpuAddress, Bits(0, 1)))
+		{
+		case 0:
+			m_pulseWaveGenerator.SetDuty(ReadBits(value, Bits(6, 7)) >> 6);
+			m_lengthCounter.SetHalt(TestBits(value, Bit(5)));
+			m_volumeEnvelope.SetLoop(TestBits(value, Bit(5))); // Same bit for length counter halt and envelope loop
+			m_volumeEnvelope.SetConstantVolumeMode(TestBits(value, Bit(4)));
+			m_volumeEnvelope.SetConstantVolume(ReadBits(value, Bits(0, 1, 2, 3)));
+			break;
+
+		case 1: // Sweep unit setup
+			m_sweepUnit.SetEnabled(TestBits(value, Bit(7)));
+			m_sweepUnit.SetPeriod(ReadBits(value, Bits(4, 5, 6)) >> 4, m_timer);
+			m_sweepUnit.SetNegate(TestBits(value, Bit(3)));
+			m_sweepUnit.SetShiftCount(ReadBits(value, Bits(0, 1, 2)));
+			m_sweepUnit.Restart(); // Side effect
+			break;
+
+		case 2:
+			m_timer.SetPeriodLow8(value);
+			break;
+
+		case 3:
+			m_timer.SetPeriodHigh3(ReadBits(value, Bits(0, 1, 2)));
+			m_lengthCounter.LoadCounterFromLUT(ReadBits(value, Bits(3, 4, 5, 6, 7)) >> 3);
+
+			// Side effects...
+			m_volumeEnvelope.Restart();
+			m_pulseWaveGenerator.Restart(); //@TODO: for pulse channels the phase is reset - IS THIS RIGHT?
+			break;
+
+		default:
+			ApuAssert(false);
+			break;
+		}
+	}
+
+	uint8_t GetValue() const
+	{
+		if (m_sweepUnit.SilenceChannel())
+			return 0;
+
+		if (m_lengthCounter.SilenceChannel())
+			return 0;
+
+		auto value = m_volumeEnvelope.GetVolume() * m_pulseWaveGenerator.GetValue();
+
+		ApuAssert(value < 16);
+		return value;
+	}
+
+private:
+	VolumeEnvelope m_volumeEnvelope;
+	SweepUnit m_sweepUnit;
+	PulseWaveGenerator m_pulseWaveGenerator;
+};
+
+// A counter used by TriangleChannel clocked twice as often as the LengthCounter.
+// Is called "linear" because it is fed the period directly rather than an index
+// into a look up table like the LengthCounter.
+class LinearCounter
+{
+public:
+	LinearCounter() : m_reload(true), m_control(true) {}
+
+	void Restart() { m_reload = true; }
+
+	// If control is false, counter will keep reloading to input period.
+	// One way to disable Triangle channel is to set control to false and
+	// period to 0 (via $4008), and then restart the LinearCounter (via $400B)
+	void SetControlAndPeriod(bool control, uint16_t period)
+	{
+		m_control = control;
+		ApuAssert(period < Bit(7));
+		m_divider.SetPeriod(period);
+	}
+
+	// Clocked by FrameCounter every CPU cycle
+	void Clock()
+	{
+		if (m_reload)
+		{
+			m_divider.ResetCounter();
+		}
+		else if (m_divider.GetCounter() > 0)
+		{
+			m_divider.Clock();
+		}
+
+		if (!m_control)
+		{
+			m_reload = false;
+		}
+	}
+
+	// If zero, sequencer is not clocked
+	uint8_t GetValue() const
+	{
+		return m_divider.GetCounter();
+	}
+
+	bool SilenceChannel() const
+	{
+		return GetValue() == 0;
+	}
+
+private:
+	bool m_reload;
+	bool m_control;
+	Divider m_divider;
+};
+
+class TriangleWaveGenerator
+{
+public:
+	TriangleWaveGenerator() : m_step(0) {}
+
+	void Clock()
+	{
+		m_step = (m_step + 1) % 32;
+	}
+
+	uint8_t GetValue() const
+	{
+		static constexpr uint8_t sequence[] =
+		{
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+		};
+		ApuAssert(m_step < 32);
+		return sequence[m_step];
+	}
+
+private:
+	uint8_t m_step;
+};
+
+class TriangleChannel : public AudioChannel
+{
+public:
+	TriangleChannel()
+	{
+		m_timer.SetMinPeriod(2); // Avoid popping from ultrasonic frequencies
+	}
+
+	void ClockQuarterFrameChips()
+	{
+		m_linearCounter.Clock();
+	}
+
+	void ClockHalfFrameChips()
+	{
+		m_lengthCounter.Clock();
+	}
+
+	void ClockTimer()
+	{
+		if (m_timer.Clock())
+		{
+			if (m_linearCounter.GetValue() > 0 && m_lengthCounter.GetValue() > 0)
+			{
+				m_triangleWaveGenerator.Clock();
+			}
+		}
+	}
+
+	void HandleCpuWrite(uint16_t cpuAddress, uint8_t value)
+	{
+		switch (cpuAddress)
+		{
+		case 0x4008:
+			m_lengthCounter.SetHalt(TestBits(value, Bit(7)));
+			m_linearCounter.SetControlAndPeriod(TestBits(value, Bit(7)), ReadBits(value, Bits(0, 1, 2, 3, 4, 5, 6)));
+			break;
+
+		case 0x400A:
+			m_timer.SetPeriodLow8(value);
+			break;
+
+		case 0x400B:
+			m_timer.SetPeriodHigh3(ReadBits(value, Bits(0, 1, 2)));
+			m_linearCounter.Restart(); // Side effect
+			m_lengthCounter.LoadCounterFromLUT(value >> 3);
+			break;
+
+		default:
+			ApuAssert(false);
+			break;
+		};
+	}
+
+	uint8_t GetValue() const
+	{
+		return m_triangleWaveGenerator.GetValue();
+	}
+
+	LinearCounter m_linearCounter;
+	TriangleWaveGenerator m_triangleWaveGenerator;
+};
+
+class LinearFeedbackShiftRegister
+{
+public:
+	LinearFeedbackShiftRegister() : m_register(1), m_mode(false) {}
+
+	// Clocked by noise channel timer
+	void Clock()
+	{
+		uint16_t bit0 = ReadBits(m_register, Bit(0));
+
+		uint16_t whichBitN = m_mode ? 6 : 1;
+		uint16_t bitN = ReadBits(m_register, Bit(whichBitN)) >> whichBitN;
+
+		uint16_t feedback = bit0 ^ bitN;
+		ApuAssert(feedback < 2);
+
+		m_register = (m_register >> 1) | (feedback << 14);
+		ApuAssert(m_register < Bit(15));
+	}
+
+	bool SilenceChannel() const
+	{
+		// If bit 0 is set, silence
+		return TestBits(m_register, Bit(0));
+	}
+
+	uint16_t m_register;
+	bool m_mode;
+};
+
+class NoiseChannel : public AudioChannel
+{
+public:
+	NoiseChannel()
+	{
+		m_volumeEnvelope.SetLoop(true); // Always looping
+	}
+
+	void ClockQuarterFrameChips()
+	{
+		m_volumeEnvelope.Clock();
+	}
+
+	void ClockHalfFrameChips()
+	{
+		m_lengthCounter.Clock();
+	}
+
+	void ClockTimer()
+	{
+		if (m_timer.Clock())
+		{
+			m_shiftRegister.Clock();
+		}
+	}
+
+	uint8_t GetValue() const
+	{
+		if (m_shiftRegister.SilenceChannel() || m_lengthCounter.SilenceChannel())
+			return 0;
+
+		return m_volumeEnvelope.GetVolume();
+	}
+
+	void HandleCpuWrite(uint16_t cpuAddress, uint8_t value)
+	{
+		switch (cpuAddress)
+		{
+		case 0x400C:
+			m_lengthCounter.SetHalt(TestBits(value, Bit(5)));
+			m_volumeEnvelope.SetConstantVolumeMode(TestBits(value, Bit(4)));
+			m_volumeEnvelope.SetConstantVolume(ReadBits(value, Bits(0, 1, 2, 3)));
+			break;
+
+		case 0x400E:
+			m_shiftRegister.m_mode = TestBits(value, Bit(7));
+			SetNoiseTimerPeriod(ReadBits(value, Bits(0, 1, 2, 3)));
+			break;
+
+		case 0x400F:
+			m_lengthCounter.LoadCounterFromLUT(value >> 3);
+			m_volumeEnvelope.Restart();
+			break;
+
+		default:
+			ApuAssert(false);
+			break;
+		};
+	}
+
+private:
+	void SetNoiseTimerPeriod(uint16_t lutIndex)
+	{
+		static constexpr uint16_t ntscPeriods[] = { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 };
+		static_assert(std::size(ntscPeriods) == 16, "Size error");
+		//size_t palPeriods[] = { 4, 8, 14, 30, 60, 88, 118, 148, 188, 236, 354, 472, 708, 944, 1890, 3778 };
+		//static_assert(std::size(palPeriods) == 16, "Size error");
+
+		ApuAssert(lutIndex < std::size(ntscPeriods));
+
+		// The LUT contains the effective period for the channel, but the timer is clocked
+		// every second CPU cycle so we divide by 2, and the divider's input is the period
+		// reload value so we subtract by 1.
+		const uint16_t periodReloadValue = (ntscPeriods[lutIndex] / 2) - 1;
+		m_timer.SetPeriod(periodReloadValue);
+	}
+
+	VolumeEnvelope m_volumeEnvelope;
+	LinearFeedbackShiftRegister m_shiftRegister;
+};
+
+// aka Frame Sequencer
+// http://wiki.nesdev.com/w/index.php/APU_Frame_Counter
+// Rather than reaching into the channels itself, the frame counter reports which
+// chips should be clocked and the Apu forwards those clocks to its channels.
+class FrameCounter
+{
+public:
+	enum Event : uint8_t
+	{
+		None = 0,
+		QuarterFrame = Bit(0),
+		HalfFrame = Bit(1),
+	};
+
+	FrameCounter()
+		: m_cpuCycles(0)
+		, m_numSteps(4)
+		, m_inhibitInterrupt(true)
+	{
+	}
+
+	uint8_t SetMode(uint8_t mode)
+	{
+		ApuAssert(mode < 2);
+		uint8_t events = None;
+		if (mode == 0)
+		{
+			m_numSteps = 4;
+		}
+		else
+		{
+			m_numSteps = 5;
+
+			//@TODO: This should happen in 3 or 4 CPU cycles
+			events = QuarterFrame | HalfFrame;
+		}
+
+		// Always restart sequence
+		//@TODO: This should happen in 3 or 4 CPU cycles
+		m_cpuCycles = 0;
+		return events;
+	}
+
+	uint8_t HandleCpuWrite(uint16_t cpuAddress, uint8_t value)
+	{
+		(void)cpuAddress;
+		ApuAssert(cpuAddress == 0x4017);
+
+		uint8_t events = SetMode(ReadBits(value, Bit(7)) >> 7);
+
+		m_inhibitInterrupt = TestBits(value, Bit(6));
+		if (m_inhibitInterrupt)
+			irq = false;
+		return events;
+	}
+
+	// Clock every CPU cycle, returns the chips that should be clocked
+	uint8_t Clock()
+	{
+		bool resetCycles = false;
+		uint8_t events = None;
+
+#define APU_TO_CPU_CYCLE(cpuCycle) static_cast<uint16_t>(cpuCycle * 2)
+
+		switch (m_cpuCycles)
+		{
+		case APU_TO_CPU_CYCLE(3728.5):
+			events = QuarterFrame;
+			break;
+
+		case APU_TO_CPU_CYCLE(7456.5):
+			events = QuarterFrame | HalfFrame;
+			break;
+
+		case APU_TO_CPU_CYCLE(11185.5):
+			events = QuarterFrame;
+			break;
+
+		case APU_TO_CPU_CYCLE(14914):
+			if (m_numSteps == 4)
+			{
+				//@TODO: set interrupt flag if !inhibit
+				Interupt();
+			}
+			break;
+
+		case APU_TO_CPU_CYCLE(14914.5):
+			if (m_numSteps == 4)
+			{
+				//@TODO: set interrupt flag if !inhibit
+				Interupt();
+				events = QuarterFrame | HalfFrame;
+			}
+			break;
+
+		case APU_TO_CPU_CYCLE(14915):
+			if (m_numSteps == 4)
+			{
+				//@TODO: set interrupt flag if !inhibit
+				Interupt();
+				resetCycles = true;
+			}
+			break;
+
+		case APU_TO_CPU_CYCLE(18640.5):
+			ApuAssert(m_numSteps == 5);
+			{
+				events = QuarterFrame | HalfFrame;
+			}
+			break;
+
+		case APU_TO_CPU_CYCLE(18641):
+			ApuAssert(m_numSteps == 5);
+			{
+				resetCycles = true;
+			}
+			break;
+		}
+
+		m_cpuCycles = resetCycles ? 0 : m_cpuCycles + 1;
+		return events;
+
+#undef APU_TO_CPU_CYCLE
+	}
+
+	bool GetIrq() const
+	{
+		return irq;
+	}
+
+	void ClearIrq()
+	{
+		irq = false;
+	}
+
+private:
+	void Interupt()
+	{
+		if (!m_inhibitInterrupt)
+			irq = true;
+	}
+
+	bool irq = false;
+	uint16_t m_cpuCycles;
+	uint8_t m_numSteps;
+	bool m_inhibitInterrupt;
+};
@@ -0,0 +1,114 @@
+#include "AudioFilterChain.h"
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define AUDIO_FILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+AudioFilterChain::AudioFilterChain(int sampleRate) :
+	sampleRate(sampleRate),
+	stages{ HighPass(90.0f, sampleRate), HighPass(440.0f, sampleRate), LowPass(14000.0f, sampleRate) }
+{
+}
+
+void AudioFilterChain::Process(float* block, int count)
+{
+	for (auto& stage : stages)
+		ProcessStage(stage, block, count, true);
+}
+
+void AudioFilterChain::ProcessScalar(float* block, int count)
+{
+	for (auto& stage : stages)
+		ProcessStage(stage, block, count, false);
+}
+
+void AudioFilterChain::Reset()
+{
+	for (auto& stage : stages)
+		stage.xPrev = stage.yPrev = 0.0f;
+}
+
+int AudioFilterChain::GetSampleRate() const
+{
+	return sampleRate;
+}
+
+AudioFilterChain::Stage AudioFilterChain::HighPass(float cutoff, int sampleRate)
+{
+	constexpr float PI = 3.14159265f;
+	float rc = 1.0f / (2.0f * PI * cutoff);
+	float dt = 1.0f / sampleRate;
+	float a = rc / (rc + dt);
+	Stage stage;
+	stage.p = a;
+	stage.b0 = a;
+	stage.b1 = -a;
+	return stage;
+}
+
+AudioFilterChain::Stage AudioFilterChain::LowPass(float cutoff, int sampleRate)
+{
+	constexpr float PI = 3.14159265f;
+	float rc = 1.0f / (2.0f * PI * cutoff);
+	float dt = 1.0f / sampleRate;
+	float a = dt / (rc + dt);
+	Stage stage;
+	stage.p = 1.0f - a;
+	stage.b0 = a;
+	stage.b1 = 0.0f;
+	return stage;
+}
+
+void AudioFilterChain::ProcessStage(Stage& stage, float* block, int count, bool vectorize)
+{
+	const float p = stage.p;
+	float xPrev = stage.xPrev;
+	float yPrev = stage.yPrev;
+	int i = 0;
+
+#ifdef AUDIO_FILTER_SSE2
+	// Four outputs at a time. The feed-forward terms are computed in
+	// parallel, then the recursion is unrolled with a two step prefix scan
+	// using powers of p, and finally the previous output is carried in.
+	const __m128 b0 = _mm_set1_ps(stage.b0);
+	const __m128 b1 = _mm_set1_ps(stage.b1);
+	const __m128 p1 = _mm_set1_ps(p);
+	const __m128 p2 = _mm_set1_ps(p * p);
+	const __m128 carry = _mm_setr_ps(p, p * p, p * p * p, p * p * p * p);
+	auto ShiftUp = [](__m128 v, int lanes)
+	{
+		__m128i bits = _mm_castps_si128(v);
+		bits = lanes == 1 ? _mm_slli_si128(bits, 4) : _mm_slli_si128(bits, 8);
+		return _mm_castsi128_ps(bits);
+	};
+	for (; vectorize && i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(block + i);
+		__m128 xShifted = _mm_or_ps(ShiftUp(x, 1), _mm_set_ss(xPrev));
+		__m128 u = _mm_add_ps(_mm_mul_ps(b0, x), _mm_mul_ps(b1, xShifted));
+		u = _mm_add_ps(u, _mm_mul_ps(p1, ShiftUp(u, 1)));
+		u = _mm_add_ps(u, _mm_mul_ps(p2, ShiftUp(u, 2)));
+		__m128 y = _mm_add_ps(u, _mm_mul_ps(carry, _mm_set1_ps(yPrev)));
+		_mm_storeu_ps(block + i, y);
+
+		xPrev = _mm_cvtss_f32(_mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)));
+		yPrev = _mm_cvtss_f32(_mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 3, 3)));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float x = block[i];
+		float y = p * yPrev + stage.b0 * x + stage.b1 * xPrev;
+		block[i] = y;
+		xPrev = x;
+		yPrev = y;
+	}
+
+	// Avoid denormals while decaying through silence
+	if (std::abs(yPrev) < 1e-20f)
+		yPrev = 0.0f;
+	stage.xPrev = xPrev;
+	stage.yPrev = yPrev;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Approximates the filters between the NES apu and its audio output: two
+// high-pass stages at 90Hz and 440Hz, which also remove the mixer's DC
+// offset, followed by a low-pass stage at 14kHz.
+class AudioFilterChain
+{
+public:
+	AudioFilterChain(int sampleRate);
+	void Process(float* block, int count);
+	// Same as Process without SSE2, as a reference to compare it against
+	void ProcessScalar(float* block, int count);
+	void Reset();
+	int GetSampleRate() const;
+private:
+	// First order stage: y[n] = p * y[n-1] + b0 * x[n] + b1 * x[n-1]
+	struct Stage
+	{
+		float p = 0.0f;
+		float b0 = 1.0f;
+		float b1 = 0.0f;
+		float xPrev = 0.0f;
+		float yPrev = 0.0f;
+	};
+	static Stage HighPass(float cutoff, int sampleRate);
+	static Stage LowPass(float cutoff, int sampleRate);
+	static void ProcessStage(Stage& stage, float* block, int count, bool vectorize);
+
+	int sampleRate;
+	Stage stages[3];
+};
@@ -0,0 +1,53 @@
+#include "AudioMixer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define AUDIO_MIXER_SSE2
+#include <emmintrin.h>
+#endif
+
+void AudioMixer::Clear(float* out, int count)
+{
+	std::fill(out, out + count, 0.0f);
+}
+
+void AudioMixer::Accumulate(float* out, const float* in, float gain, int count)
+{
+	int i = 0;
+#ifdef AUDIO_MIXER_SSE2
+	const __m128 g = _mm_set1_ps(gain);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 acc = _mm_loadu_ps(out + i);
+		__m128 src = _mm_loadu_ps(in + i);
+		_mm_storeu_ps(out + i, _mm_add_ps(acc, _mm_mul_ps(src, g)));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] += in[i] * gain;
+}
+
+void AudioMixer::ConvertToPcm16(const float* in, int16_t* out, int count)
+{
+	constexpr float SCALE = (float)std::numeric_limits<int16_t>::max();
+	int i = 0;
+#ifdef AUDIO_MIXER_SSE2
+	// Clamp, scale and round eight samples at a time, packing with saturation
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(SCALE);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lo), hi);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), lo), hi);
+		__m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+		__m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(ia, ib));
+	}
+#endif
+	// Rounds to nearest like cvtps2dq, so every sample converts the same way
+	for (; i < count; i++)
+		out[i] = (int16_t)std::lrint(std::clamp(in[i], -1.0f, 1.0f) * SCALE);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// Block mixing helpers for the audio thread. Uses SSE2 when the target
+// supports it and falls back to plain loops otherwise.
+class AudioMixer
+{
+public:
+	static void Clear(float* out, int count);
+	static void Accumulate(float* out, const float* in, float gain, int count);
+	static void ConvertToPcm16(const float* in, int16_t* out, int count);
+};
@@ -0,0 +1,48 @@
+#include "AudioSink.h"
+#include "AudioMixer.h"
+
+AudioException::AudioException(const std::string& msg) :
+	msg(msg)
+{
+}
+
+const char* AudioException::what() const noexcept
+{
+	return msg.c_str();
+}
+
+AudioSink::AudioSink(SynthFunc synth, FilterFunc filter, int sampleRate) :
+	synth(synth),
+	filter(filter),
+	sampleRate(sampleRate),
+	mixBlock(SAMPLES_PER_BLOCK)
+{
+	if (!IsSupportedSampleRate(sampleRate))
+		throw AudioException("unsupported sample rate");
+}
+
+int AudioSink::GetSampleRate() const
+{
+	return sampleRate;
+}
+
+bool AudioSink::IsSupportedSampleRate(int rate)
+{
+	for (int supported : SUPPORTED_SAMPLE_RATES)
+		if (rate == supported)
+			return true;
+	return false;
+}
+
+void AudioSink::RenderBlock(Sample* outBlock)
+{
+	synth(mixBlock.data());
+	if (filter)
+		filter(mixBlock.data());
+	AudioMixer::ConvertToPcm16(mixBlock.data(), outBlock, SAMPLES_PER_BLOCK);
+}
+
+int AudioSink::SamplesToMs(size_t samples) const
+{
+	return (int)(samples * 1000 / sampleRate);
+}
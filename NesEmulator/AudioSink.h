@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+using Sample = int16_t;
+
+// Base class for anything that pulls mixed audio from the synth callback,
+// whether that is a sound device, a file or memory
+class AudioSink
+{
+public:
+	using SynthFunc = void(*)(float* outBlock);
+	using FilterFunc = void(*)(float* block);
+	static constexpr int SAMPLES_PER_BLOCK = 512;
+	static constexpr int DEFAULT_SAMPLE_RATE = 44100;
+	static constexpr int SUPPORTED_SAMPLE_RATES[] = { 44100, 48000, 96000 };
+	static constexpr int BITS_PER_SAMPLE = sizeof(Sample) * 8;
+	static constexpr int CHANNELS = 1;
+
+	AudioSink(SynthFunc synth, FilterFunc filter, int sampleRate);
+	AudioSink(const AudioSink&) = delete;
+	AudioSink& operator=(const AudioSink&) = delete;
+	virtual ~AudioSink() = default;
+	int GetSampleRate() const;
+	virtual int GetLatencyMs() const = 0;
+	static bool IsSupportedSampleRate(int rate);
+protected:
+	// Pulls one block from the synth, filters it and converts it to pcm
+	void RenderBlock(Sample* outBlock);
+	int SamplesToMs(size_t samples) const;
+private:
+	SynthFunc synth;
+	FilterFunc filter;
+	int sampleRate;
+	std::vector<float> mixBlock;
+};
+
+class AudioException : public std::exception
+{
+public:
+	AudioException(const std::string& msg = "an audio error occurred");
+	const char* what() const noexcept override;
+private:
+	std::string msg;
+};
@@ -1,7 +1,6 @@
 #include "Cartridge.h"
-#include <fstream>
-#include <filesystem>
 #include "EmuFileException.h"
+#include "Hash.h"
 #include "Mapper000.h"
 #include "Mapper001.h"
 #include "Mapper002.h"
@@ -15,46 +14,38 @@ Cartridge::Cartridge(const std::wstring& sramPath, const std::wstring& filename)
 	filename(filename),
 	sramPath(sramPath)
 {
-	// Load file
-	std::ifstream f(filename, std::ios::binary | std::ios::ate);
-	if (!f.is_open())
-		throw EmuFileException("could not open file");
-	size_t len = static_cast<size_t>(f.tellg());
-	std::vector<uint8_t> bytes(len);
-	f.seekg(0, std::ios::beg);
-	f.read(reinterpret_cast<char*>(bytes.data()), len);
-	if (f.bad() || f.fail())
-		throw EmuFileException("error reading file");
-	f.close();
+	// Map the file, prg and chr are read straight out of the mapping
+	rom = RomImage::Open(filename);
+	const uint8_t* file = rom->Data();
+	size_t len = rom->Size();
 
 	// Extract header
-	if (bytes.size() < sizeof(header))
+	if (len < sizeof(header))
 		throw EmuFileException("invalid file format");
-	std::memcpy(&header, bytes.data(), sizeof(header));
-	if (std::string(reinterpret_cast<char*>(header.signature), 4) != "NES\x1A")
+	std::memcpy(&header, file, sizeof(header));
+	if (std::string(reinterpret_cast<const char*>(header.signature), 4) != "NES\x1A")
 		throw EmuFileException("invalid file format");
-	bytes.erase(bytes.begin(), bytes.begin() + sizeof(header));
+	size_t offset = sizeof(header);
 
 	// Extract prg
-	if (bytes.size() < static_cast<size_t>(header.prgChunks * 0x4000))
+	size_t prgSize = header.prgChunks * 0x4000;
+	if (len - offset < prgSize)
 		throw EmuFileException("expected more PRG");
-	prg.resize(header.prgChunks * 16384);
-	std::memcpy(prg.data(), bytes.data(), header.prgChunks * 0x4000);
-	bytes.erase(bytes.begin(), bytes.begin() + header.prgChunks * 0x4000);
+	prg = RomView(rom, offset, prgSize);
+	offset += prgSize;
 
 	// Extract chr
 	if (header.chrChunks == 0)
 	{
 		header.chrChunks = 4;
-		chr.resize(header.chrChunks * 8192);
+		chr = RomView(std::vector<uint8_t>(header.chrChunks * 0x2000));
 	}
 	else
 	{
-		if (bytes.size() < static_cast<size_t>(header.chrChunks * 0x2000))
+		size_t chrSize = header.chrChunks * 0x2000;
+		if (len - offset < chrSize)
 			throw EmuFileException("expected more CHR");
-		chr.resize(header.chrChunks * 8192);
-		std::memcpy(chr.data(), bytes.data(), header.chrChunks * 0x2000);
-		bytes.erase(bytes.begin(), bytes.begin() + header.chrChunks * 0x2000);
+		chr = RomView(rom, offset, chrSize);
 	}
 
 	// Select mapper
@@ -64,40 +55,41 @@ Cartridge::Cartridge(const std::wstring& sramPath, const std::wstring& filename)
 		LoadMapper(header.flag6.lowerMapperNumber);
 
 	// Load sram
-	std::ifstream sf(sramPath, std::ios::binary | std::ios::ate);
-	if (!sf.is_open())
-		return;
-	len = (size_t)sf.tellg();
-	sf.seekg(0);
-	std::vector<uint8_t> sram(len);
-	sf.read(reinterpret_cast<char*>(sram.data()), len);
-	if (sf.bad() || sf.fail())
-		return;
-	mapper->SetSRam(sram);
+	OpenSRam(true);
+}
+
+Cartridge::Cartridge(const std::wstring& filename) :
+	filename(filename),
+	header{}
+{
 }
 
-Cartridge::Cartridge(const std::wstring& sramPath, const std::wstring& filename, Snapshot& bytes) :
+Cartridge::Cartridge(const std::wstring& sramPath, const std::wstring& filename, StateReader& bytes, StateReader& mapperBytes) :
 	filename(filename),
 	sramPath(sramPath)
 {
 	int mapperNumber = 0;
+	uint64_t hash = 0;
 	LoadBytes(bytes, mapperNumber);
-	LoadMapper(mapperNumber, &bytes);
-
-	LoadBytes(bytes, header);
+	LoadBytes(bytes, hash);
 
-	size_t vecLen;
-	LoadBytes(bytes, vecLen);
-	if (vecLen > 1024 * 1024 * 512)
-		throw EmuFileException("invalid file");
-	prg.resize(vecLen);
-	LoadBytes(bytes, prg.data(), prg.size());
+	// Prefer an image that is already open, then the rom's own path
+	if (hash)
+	{
+		rom = RomImage::Find(hash);
+		if (!rom)
+			rom = RomImage::Open(filename);
+		if (rom->Hash() != hash)
+			throw EmuFileException("rom does not match save state");
+	}
 
-	LoadBytes(bytes, vecLen);
-	if (vecLen > 1024 * 1024 * 512)
+	LoadBytes(bytes, header);
+	LoadMapper(mapperNumber);
+	mapper->LoadState(mapperBytes);
+	LoadView(bytes, prg);
+	LoadView(bytes, chr);
+	if (bytes.Remaining() > 0 || mapperBytes.Remaining() > 0)
 		throw EmuFileException("invalid file");
-	chr.resize(vecLen);
-	LoadBytes(bytes, chr.data(), chr.size());
 }
 
 Cartridge::~Cartridge()
@@ -105,23 +97,114 @@ Cartridge::~Cartridge()
 	SaveSRam();
 }
 
-Snapshot Cartridge::SaveState() const
+void Cartridge::SaveState(StateWriter& bytes) const
 {
-	std::vector<uint8_t> bytes;
 	SaveBytes(bytes, mapper->MapperNumber());
-	AppendVector(bytes, mapper->SaveState());
-
+	SaveBytes(bytes, rom ? rom->Hash() : (uint64_t)0);
 	SaveBytes(bytes, header);
+	SaveView(bytes, prg);
+	SaveView(bytes, chr);
+}
+
+bool Cartridge::CanLoadState(const std::wstring& filename, StateReader bytes) const
+{
+	int mapperNumber = 0;
+	uint64_t hash = 0;
+	LoadBytes(bytes, mapperNumber);
+	LoadBytes(bytes, hash);
+	return filename == this->filename
+		&& mapperNumber == mapper->MapperNumber()
+		&& hash == (rom ? rom->Hash() : 0);
+}
+
+void Cartridge::LoadState(StateReader& bytes, StateReader& mapperBytes)
+{
+	int mapperNumber = 0;
+	uint64_t hash = 0;
+	LoadBytes(bytes, mapperNumber);
+	LoadBytes(bytes, hash);
+	LoadBytes(bytes, header);
+	mapper->LoadState(mapperBytes);
+	LoadView(bytes, prg);
+	LoadView(bytes, chr);
+}
+
+void Cartridge::CheckState(StateReader bytes) const
+{
+	bytes.Skip(sizeof(int) + sizeof(uint64_t) + sizeof(header));
+	CheckView(bytes);
+	CheckView(bytes);
+	if (bytes.Remaining() > 0)
+		throw EmuFileException("invalid file");
+}
+
+uint64_t Cartridge::HashState(uint64_t hash) const
+{
+	uint64_t romHash = rom ? rom->Hash() : 0;
+	hash = HashBytes(&romHash, sizeof(romHash), hash);
+	hash = mapper->HashState(hash);
+	hash = HashView(prg, hash);
+	return HashView(chr, hash);
+}
+
+void Cartridge::SaveView(StateWriter& bytes, const RomView& view) const
+{
+	SaveBytes(bytes, view.IsShared());
+	if (view.IsShared())
+		SaveBytes(bytes, view.Offset());
+	SaveBytes(bytes, view.size());
+	if (!view.IsShared())
+		view.Owned().SaveState(bytes);
+}
+
+void Cartridge::LoadView(StateReader& bytes, RomView& view) const
+{
+	bool shared = false;
+	size_t offset = 0;
+	size_t len = 0;
+	LoadBytes(bytes, shared);
+	if (shared)
+		LoadBytes(bytes, offset);
+	LoadBytes(bytes, len);
+
+	if (shared)
+	{
+		if (!rom || offset > rom->Size() || len > rom->Size() - offset)
+			throw EmuFileException("invalid file");
+		view = RomView(rom, offset, len);
+		return;
+	}
 
-	size_t vecLen = prg.size();
-	SaveBytes(bytes, vecLen);
-	SaveBytes(bytes, prg.data(), prg.size());
+	if (len > bytes.Remaining())
+		throw EmuFileException("invalid file");
+	view.Own(len).LoadState(bytes);
+}
 
-	vecLen = chr.size();
-	SaveBytes(bytes, vecLen);
-	SaveBytes(bytes, chr.data(), chr.size());
+void Cartridge::CheckView(StateReader& bytes) const
+{
+	bool shared = false;
+	size_t offset = 0;
+	size_t len = 0;
+	LoadBytes(bytes, shared);
+	if (shared)
+		LoadBytes(bytes, offset);
+	LoadBytes(bytes, len);
 
-	return bytes;
+	if (shared && (!rom || offset > rom->Size() || len > rom->Size() - offset))
+		throw EmuFileException("invalid file");
+	if (!shared)
+		bytes.Skip(len);
+}
+
+uint64_t Cartridge::HashView(const RomView& view, uint64_t hash) const
+{
+	// The rom itself is covered by its hash
+	if (view.IsShared())
+	{
+		const size_t position[] = { view.Offset(), view.size() };
+		return HashBytes(position, sizeof(position), hash);
+	}
+	return view.Owned().Hash(hash);
 }
 
 void Cartridge::Reset()
@@ -129,9 +212,9 @@ void Cartridge::Reset()
 	mapper->Reset();
 }
 
-void Cartridge::LoadMapper(int mapperNumber, Snapshot* bytes)
+void Cartridge::LoadMapper(int mapperNumber)
 {
-#define Load(type) mapper = bytes ? std::make_unique<type>(*bytes, prg, chr) : std::make_unique<type>(mapperNumber, header.prgChunks, header.chrChunks, prg, chr)
+#define Load(type) mapper = std::make_unique<type>(mapperNumber, header.prgChunks, header.chrChunks, prg, chr)
 	switch (mapperNumber)
 	{
 	case   0: Load(Mapper000); break;
@@ -186,23 +269,50 @@ const Mapper& Cartridge::GetMapper() const
 	return *mapper;
 }
 
+std::shared_ptr<Cartridge> Cartridge::Fork() const
+{
+	std::shared_ptr<Cartridge> fork(new Cartridge(filename));
+	fork->header = header;
+	fork->rom = rom;
+	fork->prg = prg.Fork();
+	fork->chr = chr.Fork();
+	fork->mapper = mapper->Fork(fork->prg, fork->chr);
+	if (!fork->mapper)
+		return nullptr;
+	return fork;
+}
+
 bool Cartridge::SaveSRam() const
 {
-	const auto* sram = GetMapper().GetSRam();
-	if (sram == nullptr || sram->size() == 0)
+	// Forks and the nsf player have no journal
+	if (!sramJournal)
 		return true;
+	sramJournal->Record(*mapper->GetSRam());
+	return sramJournal->Flush();
+}
 
-	auto GetDirectory = [](const std::wstring& path)
-	{
-		return path.substr(0, path.find_last_of(L"/\\"));
-	};
-	std::error_code ec;
-	std::filesystem::create_directory(GetDirectory(sramPath), ec);
+void Cartridge::JournalSRam() const
+{
+	if (sramJournal)
+		sramJournal->Record(*mapper->GetSRam());
+}
 
-	std::ofstream f(sramPath, std::ios::binary);
-	if (!f.is_open())
-		return false;
+bool Cartridge::HasSRamJournal() const
+{
+	return sramJournal != nullptr;
+}
 
-	f.write(reinterpret_cast<const char*>(sram->data()), sram->size());
-	return !(f.bad() || f.fail());
+void Cartridge::OpenSRam(bool load)
+{
+	const PagedMemory* sram = mapper->GetSRam();
+	if (sramPath.empty() || sram == nullptr || sram->size() == 0)
+		return;
+	sramJournal = SRamJournal::Open(sramPath, sram->size());
+	if (!load)
+		return;
+	if (sramJournal->Loaded())
+		mapper->SetSRam(sramJournal->Image());
+	// What was just read is already on disk
+	std::vector<size_t> pages;
+	sram->TakeDirtyPages(pages);
 }
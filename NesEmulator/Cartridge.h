@@ -4,14 +4,22 @@
 #include <cstdint>
 #include <memory>
 #include "Mapper.h"
+#include "RomView.h"
 #include "SaveStateUtil.h"
+#include "SRamJournal.h"
 
 class Cartridge
 {
 	friend class Emulator;
+	friend class NsfPlayer;
+	friend class Nes;
 public:
 	Cartridge(const std::wstring& sramPath, const std::wstring& filename);
-	Cartridge(const std::wstring& sramPath, const std::wstring& filename, Snapshot& bytes);
+	// The mapper's state is saved separately from the rest, so it has its
+	// own reader. Throws unless both are read to the end.
+	// The sram journal is left closed until Nes has accepted the rest of
+	// the state, so a rejected state never reaches the save.
+	Cartridge(const std::wstring& sramPath, const std::wstring& filename, StateReader& bytes, StateReader& mapperBytes);
 	Cartridge(const Cartridge&) = delete;
 	Cartridge& operator=(const Cartridge&) = delete;
 	~Cartridge();
@@ -23,11 +31,39 @@ public:
 	MirrorMode GetMirrorMode() const;
 	Mapper& GetMapper();
 	const Mapper& GetMapper() const;
-	Snapshot SaveState() const;
+	// Saves everything but the mapper, which is saved through GetMapper
+	void SaveState(StateWriter& bytes) const;
+	// Whether a state can be loaded into this cartridge in place, which
+	// needs the same rom and mapper
+	bool CanLoadState(const std::wstring& filename, StateReader bytes) const;
+	void LoadState(StateReader& bytes, StateReader& mapperBytes);
+	// Throws unless LoadState would read the section to the end without
+	// failing
+	void CheckState(StateReader bytes) const;
+	uint64_t HashState(uint64_t hash) const;
+	// Writes the sram pages changed since the last call into the save and
+	// waits for them
 	bool SaveSRam() const;
+	// Journals the sram pages changed since the last call in the
+	// background. Called between frames on the emulation thread.
+	void JournalSRam() const;
+	bool HasSRamJournal() const;
+	// Copy that shares the rom and any written memory page by page until
+	// one of them writes. Forks never write sram to disk. Returns null if
+	// the mapper can't be copied.
+	std::shared_ptr<Cartridge> Fork() const;
 	const std::wstring filename;
 private:
-	void LoadMapper(int mapperNumber, Snapshot* bytes = nullptr);
+	// Empty cartridge for the nsf player, which supplies its own prg and mapper
+	Cartridge(const std::wstring& filename);
+	void LoadMapper(int mapperNumber);
+	// Opens the sram journal, loading the save into the mapper if asked
+	void OpenSRam(bool load);
+	// Views still shared with the rom are saved as a reference into it
+	void SaveView(StateWriter& bytes, const RomView& view) const;
+	void LoadView(StateReader& bytes, RomView& view) const;
+	void CheckView(StateReader& bytes) const;
+	uint64_t HashView(const RomView& view, uint64_t hash) const;
 	std::unique_ptr<Mapper> mapper;
 	struct Header
 	{
@@ -52,7 +88,9 @@ private:
 		uint8_t prgRamSize;
 		uint8_t padding[7];
 	} header;
-	std::vector<uint8_t> prg;
-	std::vector<uint8_t> chr;
+	std::shared_ptr<const RomImage> rom;
+	RomView prg;
+	RomView chr;
 	std::wstring sramPath;
+	std::shared_ptr<SRamJournal> sramJournal;
 };
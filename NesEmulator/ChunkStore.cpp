@@ -0,0 +1,284 @@
+#include "ChunkStore.h"
+#include <algorithm>
+#include "Hash.h"
+
+ChunkStore::ChunkStore(const std::wstring& directory) :
+	directory(directory),
+	packPath(this->directory / L"chunks.pack")
+{
+	std::error_code ec;
+	std::filesystem::create_directories(this->directory / L"states", ec);
+	OpenPack();
+
+	for (const auto& entry : std::filesystem::directory_iterator(this->directory / L"states", ec))
+	{
+		std::vector<ChunkRef> refs;
+		if (entry.path().extension() != L".tmp" && ReadState(entry.path().filename().wstring(), refs))
+			AddRefs(refs);
+	}
+	if (deadBytes > MIN_COMPACT_SIZE && deadBytes > packEnd / 2)
+		Compact();
+}
+
+bool ChunkStore::Put(const std::wstring& name, const uint8_t* data, size_t size, const std::vector<size_t>& splits)
+{
+	std::vector<size_t> bounds(splits);
+	bounds.push_back(0);
+	bounds.push_back(size);
+	std::sort(bounds.begin(), bounds.end());
+
+	std::unique_lock<std::mutex> lock(mtx);
+	std::vector<ChunkRef> refs;
+	for (size_t i = 0; i + 1 < bounds.size(); i++)
+	{
+		size_t end = std::min(bounds[i + 1], size);
+		for (size_t offset = bounds[i]; offset < end; offset += CHUNK_SIZE)
+		{
+			size_t n = std::min(CHUNK_SIZE, end - offset);
+			ChunkRef ref{ HashBytes(data + offset, n), (uint32_t)n };
+			auto it = chunks.find(ref.hash);
+			if (it == chunks.end() ? !Append(ref, data + offset) : it->second.size != ref.size)
+				return false;
+			refs.push_back(ref);
+		}
+	}
+
+	// The chunks are in the pack before the state that lists them is
+	pack.flush();
+	std::vector<ChunkRef> old;
+	ReadState(name, old);
+	if (pack.fail() || !WriteState(name, refs))
+		return false;
+	AddRefs(refs);
+	Release(old);
+	return true;
+}
+
+bool ChunkStore::Get(const std::wstring& name, Snapshot& data)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	std::vector<ChunkRef> refs;
+	if (!ReadState(name, refs))
+		return false;
+
+	data.clear();
+	for (const ChunkRef& ref : refs)
+	{
+		auto it = chunks.find(ref.hash);
+		if (it == chunks.end() || it->second.size != ref.size)
+			return false;
+		size_t at = data.size();
+		data.resize(at + ref.size);
+		pack.clear();
+		pack.seekg(it->second.offset);
+		pack.read(reinterpret_cast<char*>(data.data() + at), ref.size);
+		if (pack.fail() || HashBytes(data.data() + at, ref.size) != ref.hash)
+			return false;
+	}
+	return true;
+}
+
+void ChunkStore::Remove(const std::wstring& name)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	std::vector<ChunkRef> refs;
+	if (!ReadState(name, refs))
+		return;
+	std::error_code ec;
+	if (std::filesystem::remove(StatePath(name), ec))
+		Release(refs);
+}
+
+size_t ChunkStore::ChunkCount() const
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	return chunks.size();
+}
+
+uint64_t ChunkStore::PackSize() const
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	return packEnd;
+}
+
+void ChunkStore::OpenPack()
+{
+	// Every chunk starts out unreferenced until the states are read. A
+	// chunk cut short by a crash, and anything after it, is cut off.
+	chunks.clear();
+	packEnd = 0;
+	deadBytes = 0;
+	{
+		std::ifstream f(packPath, std::ios::binary | std::ios::ate);
+		uint64_t fileSize = f.is_open() ? (uint64_t)f.tellg() : 0;
+		f.seekg(0);
+		PackEntry entry{};
+		while (fileSize - packEnd >= sizeof(entry))
+		{
+			f.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+			if (f.fail() || entry.magic != PackEntry::MAGIC || entry.size > fileSize - packEnd - sizeof(entry))
+				break;
+			uint64_t offset = packEnd + sizeof(entry);
+			chunks.emplace(entry.hash, Chunk{ offset, entry.size, 0 });
+			packEnd = offset + entry.size;
+			deadBytes += sizeof(entry) + entry.size;
+			f.seekg(packEnd);
+		}
+		f.close();
+		std::error_code ec;
+		if (fileSize != packEnd)
+			std::filesystem::resize_file(packPath, packEnd, ec);
+	}
+
+	// Opening for update needs the file to exist
+	pack.close();
+	pack.clear();
+	std::ofstream(packPath, std::ios::binary | std::ios::app).close();
+	pack.open(packPath, std::ios::binary | std::ios::in | std::ios::out);
+}
+
+bool ChunkStore::ReadState(const std::wstring& name, std::vector<ChunkRef>& refs) const
+{
+	std::ifstream f(StatePath(name), std::ios::binary | std::ios::ate);
+	if (!f.is_open())
+		return false;
+	size_t len = (size_t)f.tellg();
+	f.seekg(0);
+	StateFile header{};
+	f.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (f.fail()
+		|| header.magic != StateFile::MAGIC
+		|| header.chunkCount > (len - sizeof(header)) / sizeof(ChunkRef))
+		return false;
+	refs.resize(header.chunkCount);
+	f.read(reinterpret_cast<char*>(refs.data()), refs.size() * sizeof(ChunkRef));
+	return !f.fail();
+}
+
+bool ChunkStore::WriteState(const std::wstring& name, const std::vector<ChunkRef>& refs) const
+{
+	// Renamed into place so that the old list stays whole until the new
+	// one is
+	std::filesystem::path path = StatePath(name);
+	std::filesystem::path temp = path;
+	temp += L".tmp";
+	std::error_code ec;
+
+	std::ofstream f(temp, std::ios::binary);
+	if (!f.is_open())
+		return false;
+	StateFile header{ StateFile::MAGIC, (uint32_t)refs.size() };
+	f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	f.write(reinterpret_cast<const char*>(refs.data()), refs.size() * sizeof(ChunkRef));
+	f.close();
+	if (f.fail())
+	{
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	std::filesystem::rename(temp, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	return true;
+}
+
+bool ChunkStore::Append(const ChunkRef& ref, const uint8_t* data)
+{
+	PackEntry entry{ PackEntry::MAGIC, ref.size, ref.hash };
+	pack.clear();
+	pack.seekp(packEnd);
+	pack.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	pack.write(reinterpret_cast<const char*>(data), ref.size);
+	if (pack.fail())
+		return false;
+	chunks.emplace(ref.hash, Chunk{ packEnd + sizeof(entry), ref.size, 0 });
+	packEnd += sizeof(entry) + ref.size;
+	deadBytes += sizeof(entry) + ref.size;
+	return true;
+}
+
+void ChunkStore::AddRefs(const std::vector<ChunkRef>& refs)
+{
+	for (const ChunkRef& ref : refs)
+	{
+		auto it = chunks.find(ref.hash);
+		if (it == chunks.end())
+			continue;
+		if (it->second.refs++ == 0)
+			deadBytes -= sizeof(PackEntry) + it->second.size;
+	}
+}
+
+void ChunkStore::Release(const std::vector<ChunkRef>& refs)
+{
+	for (const ChunkRef& ref : refs)
+	{
+		auto it = chunks.find(ref.hash);
+		if (it == chunks.end() || it->second.refs == 0)
+			continue;
+		if (--it->second.refs == 0)
+			deadBytes += sizeof(PackEntry) + it->second.size;
+	}
+	if (deadBytes > MIN_COMPACT_SIZE && deadBytes > packEnd / 2)
+		Compact();
+}
+
+void ChunkStore::Compact()
+{
+	// The live chunks are copied to a new pack that is renamed over the old
+	// one. The states name chunks by hash, so they don't change.
+	std::filesystem::path temp = packPath;
+	temp += L".tmp";
+	std::ofstream out(temp, std::ios::binary);
+	if (!out.is_open())
+		return;
+	std::vector<uint8_t> buffer;
+	for (const auto& [hash, chunk] : chunks)
+	{
+		if (chunk.refs == 0)
+			continue;
+		buffer.resize(chunk.size);
+		pack.clear();
+		pack.seekg(chunk.offset);
+		pack.read(reinterpret_cast<char*>(buffer.data()), chunk.size);
+		if (pack.fail())
+			continue;
+		PackEntry entry{ PackEntry::MAGIC, chunk.size, hash };
+		out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		out.write(reinterpret_cast<const char*>(buffer.data()), chunk.size);
+	}
+	out.close();
+
+	std::error_code ec;
+	if (out.fail())
+	{
+		std::filesystem::remove(temp, ec);
+		return;
+	}
+	pack.close();
+	std::filesystem::rename(temp, packPath, ec);
+	if (ec)
+		std::filesystem::remove(temp, ec);
+
+	// Reading the new pack back gives the new offsets
+	std::unordered_map<uint64_t, Chunk> old;
+	old.swap(chunks);
+	OpenPack();
+	for (auto& [hash, chunk] : chunks)
+	{
+		auto it = old.find(hash);
+		if (it != old.end() && it->second.refs > 0)
+		{
+			chunk.refs = it->second.refs;
+			deadBytes -= sizeof(PackEntry) + chunk.size;
+		}
+	}
+}
+
+std::filesystem::path ChunkStore::StatePath(const std::wstring& name) const
+{
+	return directory / L"states" / name;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "PagedMemory.h"
+#include "SaveStateUtil.h"
+
+// Stores named states as lists of chunks named by their hash, so a chunk
+// that many states share is kept once. Chunks are appended to one pack
+// file and dropped once no state refers to them, and the pack is rewritten
+// without them when they take up most of it.
+//
+// Each state is a small file listing its chunks. Chunks in the pack carry
+// their own hash and size, and the reference counts are rebuilt from the
+// states when the store is opened, so a crash can at most leave chunks
+// that nothing refers to, which are dropped the same way. One store can be
+// shared between threads.
+class ChunkStore
+{
+public:
+	static constexpr size_t CHUNK_SIZE = PagedMemory::PAGE_SIZE;
+
+	explicit ChunkStore(const std::wstring& directory);
+	ChunkStore(const ChunkStore&) = delete;
+	ChunkStore& operator=(const ChunkStore&) = delete;
+	// Replaces the named state. The data is split at each of the offsets
+	// given and every CHUNK_SIZE bytes after them, so fields that keep
+	// their place from one state to the next land in the same chunks.
+	// Names are used as filenames.
+	bool Put(const std::wstring& name, const uint8_t* data, size_t size, const std::vector<size_t>& splits);
+	// Returns false if the state is missing or any of its chunks is bad
+	bool Get(const std::wstring& name, Snapshot& data);
+	void Remove(const std::wstring& name);
+	size_t ChunkCount() const;
+	// Bytes on disk in the pack, including chunks not yet compacted away
+	uint64_t PackSize() const;
+private:
+	struct ChunkRef
+	{
+		uint64_t hash;
+		uint32_t size;
+	};
+	struct PackEntry
+	{
+		static constexpr uint32_t MAGIC = 0x4B4E4843; // "CHNK"
+		uint32_t magic;
+		uint32_t size;
+		uint64_t hash;
+	};
+	struct StateFile
+	{
+		static constexpr uint32_t MAGIC = 0x5453454E; // "NEST"
+		uint32_t magic;
+		uint32_t chunkCount;
+	};
+	struct Chunk
+	{
+		uint64_t offset;
+		uint32_t size;
+		int refs;
+	};
+	// Dead chunks are only compacted away past this much, so that a store
+	// of a few states isn't rewritten on every save
+	static constexpr uint64_t MIN_COMPACT_SIZE = 1024 * 1024;
+
+	void OpenPack();
+	bool ReadState(const std::wstring& name, std::vector<ChunkRef>& chunks) const;
+	bool WriteState(const std::wstring& name, const std::vector<ChunkRef>& chunks) const;
+	bool Append(const ChunkRef& ref, const uint8_t* data);
+	void AddRefs(const std::vector<ChunkRef>& chunks);
+	void Release(const std::vector<ChunkRef>& chunks);
+	void Compact();
+	std::filesystem::path StatePath(const std::wstring& name) const;
+
+	const std::filesystem::path directory;
+	const std::filesystem::path packPath;
+	std::fstream pack;
+	uint64_t packEnd = 0;
+	uint64_t deadBytes = 0;
+	std::unordered_map<uint64_t, Chunk> chunks;
+	mutable std::mutex mtx;
+};
@@ -80,14 +80,25 @@ Controller::~Controller()
 
 void Controller::SetState()
 {
-	state = 0;
+	state = Poll();
+}
+
+void Controller::SetState(uint8_t buttons)
+{
+	state = buttons;
+}
+
+uint8_t Controller::Poll() const
+{
+	uint8_t buttons = 0;
 	if (input != nullptr && tmplate->enabled && !(input->GetKey(Key::Alt) || input->GetKey(Key::Ctrl)))
 	{
 		for (size_t i = 0; i < std::size(keyMappings); i++)
 		{
-			state |= input->GetKey(keyMappings[i]) << i;
+			buttons |= input->GetKey(keyMappings[i]) << i;
 		}
 	}
+	return buttons;
 }
 
 uint8_t Controller::Read()
@@ -105,3 +116,13 @@ void Controller::UpdateKeyMappings()
 	for (Key key : keyMappings)
 		input->ListenToKey(key);
 }
+
+void Controller::SaveState(StateWriter& bytes) const
+{
+	SaveBytes(bytes, state);
+}
+
+void Controller::LoadState(StateReader& bytes)
+{
+	LoadBytes(bytes, state);
+}
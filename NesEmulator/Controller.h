@@ -1,5 +1,6 @@
 #pragma once
 #include "Input.h"
+#include "SaveStateUtil.h"
 #include <string>
 #include <memory>
 
@@ -29,8 +30,15 @@ public:
 	Controller(const std::unique_ptr<ControllerTemplate>& tmplate, Input& input);
 	~Controller();
 	void SetState();
+	// Latches buttons given from elsewhere, e.g. netplay, instead of the keys
+	void SetState(uint8_t buttons);
+	// Current buttons held on the keys, in the same bit order as the latch
+	uint8_t Poll() const;
 	uint8_t Read();
 	void UpdateKeyMappings();
+	// Only the shift register is machine state, the key mappings aren't
+	void SaveState(StateWriter& bytes) const;
+	void LoadState(StateReader& bytes);
 	const ControllerTemplate* tmplate;
 private:
 	Input* input;
@@ -70,8 +70,7 @@ Cpu::Cpu(Nes& nes) :
 	cyclesToNextInstruction = 8;
 }
 
-Cpu::Cpu(Nes& nes, Snapshot& bytes) :
-	nes(nes)
+void Cpu::LoadState(StateReader& bytes)
 {
 	LoadBytes(bytes, cyclesToNextInstruction);
 	LoadBytes(bytes, ra);
@@ -82,9 +81,8 @@ Cpu::Cpu(Nes& nes, Snapshot& bytes) :
 	LoadBytes(bytes, status);
 }
 
-Snapshot Cpu::SaveState() const
+void Cpu::SaveState(StateWriter& bytes) const
 {
-	std::vector<uint8_t> bytes;
 	SaveBytes(bytes, cyclesToNextInstruction);
 	SaveBytes(bytes, ra);
 	SaveBytes(bytes, rx);
@@ -92,7 +90,6 @@ Snapshot Cpu::SaveState() const
 	SaveBytes(bytes, sp);
 	SaveBytes(bytes, pc);
 	SaveBytes(bytes, status);
-	return bytes;
 }
 
 void Cpu::Clock()
@@ -9,9 +9,9 @@ class Nes;
 class Cpu
 {
 	friend class Emulator;
+	friend class NsfPlayer;
 public:
 	Cpu(Nes& nes);
-	Cpu(Nes& nes, Snapshot& bytes);
 	Cpu(const Cpu&) = delete;
 	Cpu& operator=(const Cpu&) = delete;
 	void Clock();
@@ -20,7 +20,8 @@ public:
 	void Nmi();
 	void ClockInstruction();
 	bool InstructionComplete() const;
-	Snapshot SaveState() const;
+	void LoadState(StateReader& bytes);
+	void SaveState(StateWriter& bytes) const;
 private:
 	Nes& nes;
 	uint8_t opcode = 0;
@@ -2,9 +2,13 @@
 #include <fstream>
 #include "Emulator.h"
 #include "Timer.h"
+#include "AudioMixer.h"
 #include "resource.h"
 #include <stack>
 #include <filesystem>
+#include <ctime>
+#include <optional>
+#include <sstream>
 #include "EmuFileException.h"
 #include "DebugLogger.h"
 
@@ -12,25 +16,24 @@
 
 void Emulator::AudioRequest(float* out)
 {
-	for (int i = 0; i < Audio::SAMPLES_PER_BLOCK; i++)
-		out[i] = 0.0f;
+	constexpr int BUF_LEN = AudioSink::SAMPLES_PER_BLOCK;
+	AudioMixer::Clear(out, BUF_LEN);
 
 	if (em == nullptr)
 		return;
 
+	// Each instance renders into a scratch block which is mixed in with
+	// an equal share of the gain
 	int count = (int)em->neses.size();
+	if (count == 0)
+		return;
+	float gain = 1.0f / (float)count;
+	em->mixBuffer.resize(BUF_LEN);
 	for (auto& nes : em->neses)
 	{
 		auto apu = nes->apu;
-		if (apu)
-			apu->GetSamples(out);
-	}
-
-	if (count)
-	{
-		float m = 1.0f / (float)count;
-		for (int i = 0; i < Audio::SAMPLES_PER_BLOCK; i++)
-			out[i] *= m;
+		if (apu && apu->GetSamples(em->mixBuffer.data()))
+			AudioMixer::Accumulate(out, em->mixBuffer.data(), gain, BUF_LEN);
 	}
 }
 
@@ -60,6 +63,8 @@ constexpr int IDM_NESOFFSET_CLOSE = 27 + 5;
 constexpr int IDM_NESOFFSET_CTRL = 28 + 5;
 constexpr int IDM_NESOFFSET_SPEED = 36 + 5;
 constexpr int IDM_NESOFFSET_MUTE = 44 + 5;
+constexpr int IDM_NESOFFSET_RECORDSTEMS = 45 + 5;
+constexpr int IDM_NESOFFSET_FILTER = 46 + 5;
 constexpr int IDM_NESOFFSET_REMOVE = 99;
 
 constexpr int CCF_OFFSET = 130;
@@ -103,6 +108,14 @@ enum
 	IDM_EMU_ENABLEAUDIO,
 	IDM_EMU_PAUSEONFOCUSLOST,
 	IDM_EMU_EXTERNALINPUT,
+	IDM_EMU_SAMPLERATE44100,
+	IDM_EMU_SAMPLERATE48000,
+	IDM_EMU_SAMPLERATE96000,
+	IDM_EMU_RUNAHEAD0,
+	IDM_EMU_RUNAHEAD1,
+	IDM_EMU_RUNAHEAD2,
+	IDM_EMU_RUNAHEAD3,
+	IDM_EMU_NETPLAY,
 	IDM_EMU_ADDNES,
 
 	IDM_DBG_MEMDUMP,
@@ -127,6 +140,8 @@ Emulator* Emulator::em;
 const std::wstring Emulator::INI_FILENAME = L"ini";
 const std::wstring Emulator::SAVE_DIR = L"save_states";
 const std::wstring Emulator::SAVE_FILENAME = Emulator::SAVE_DIR + L"/sav";
+const std::wstring Emulator::RESUME_FILENAME = Emulator::SAVE_DIR + L"/resume";
+const std::wstring Emulator::RECORDINGS_DIR = L"recordings";
 
 Emulator::Emulator() :
 	title(L"Nes Emulator - "),
@@ -175,6 +190,7 @@ Emulator::Emulator() :
 		Key::W, Key::O, Key::P, Key::M, Key::N, Key::R,
 		Key::A, Key::B, Key::C, Key::D, Key::E, Key::F,
 		Key::LeftArrow, Key::RightArrow, Key::DownArrow, Key::UpArrow,
+		Key::BackSpace,
 	};
 	for (Key key : keys)
 		input.ListenToKey(key);
@@ -583,11 +599,13 @@ LRESULT CALLBACK Emulator::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lP
 				DestroyWindow(hWnd);
 				break;
 			case IDM_FILE_CLOSEROM:
+				em->StopNetplay();
 				for (auto& nes : em->neses)
 					nes->RemoveCartridge();
 				em->UpdateMenu();
 				break;
 			case IDM_FILE_RELOAD:
+				em->StopNetplay();
 				for (auto& nes : em->neses)
 					if (nes->cart)
 						nes->Reset();
@@ -630,9 +648,32 @@ LRESULT CALLBACK Emulator::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lP
 				if (em->audio)
 					em->audio.reset();
 				else
-					em->audio = std::make_unique<Audio>(Emulator::AudioRequest);
+					em->CreateAudio();
+				em->SaveIni();
+				break;
+			case IDM_EMU_SAMPLERATE44100:
+				em->SetSampleRate(44100);
+				break;
+			case IDM_EMU_SAMPLERATE48000:
+				em->SetSampleRate(48000);
+				break;
+			case IDM_EMU_SAMPLERATE96000:
+				em->SetSampleRate(96000);
+				break;
+			case IDM_EMU_RUNAHEAD0:
+			case IDM_EMU_RUNAHEAD1:
+			case IDM_EMU_RUNAHEAD2:
+			case IDM_EMU_RUNAHEAD3:
+				em->runAheadFrames = (int)(LOWORD(wParam) - IDM_EMU_RUNAHEAD0);
+				em->UpdateMenu();
 				em->SaveIni();
 				break;
+			case IDM_EMU_NETPLAY:
+				if (em->netplay)
+					em->StopNetplay();
+				else
+					em->StartNetplay(em->netplaySettings);
+				break;
 			case IDM_EMU_PAUSE:
 				if (em->MainNes()->running)
 					for (auto& nes : em->neses)
@@ -803,7 +844,8 @@ LRESULT CALLBACK Emulator::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lP
 			case IDM_DBG_MEMDUMP:
 				if (em->Debuggable() && em->MainNes()->cart)
 				{
-					std::vector<uint8_t> vec(em->MainNes()->ram, em->MainNes()->ram + std::size(em->MainNes()->ram));
+					std::vector<uint8_t> vec(em->MainNes()->ram.size());
+					em->MainNes()->ram.Read(0, vec.data(), vec.size());
 					em->SaveFile(vec);
 				}
 				break;
@@ -872,11 +914,15 @@ LRESULT CALLBACK Emulator::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lP
 				else if (InRange(id, IDM_NESOFFSET_CLOSE))
 				{
 					// Close
+					if (nesNum == 0)
+						em->StopNetplay();
 					em->neses[nesNum]->RemoveCartridge();
 				}
 				else if (InRange(id, IDM_NESOFFSET_RELOAD))
 				{
 					// Reload
+					if (nesNum == 0)
+						em->StopNetplay();
 					if (em->neses[nesNum]->cart)
 						em->neses[nesNum]->Reset();
 				}
@@ -885,6 +931,17 @@ LRESULT CALLBACK Emulator::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lP
 					// Mute
 					em->neses[nesNum]->mute = !em->neses[nesNum]->mute;
 				}
+				else if (InRange(id, IDM_NESOFFSET_FILTER))
+				{
+					// Hardware audio filter
+					em->neses[nesNum]->filterAudio = !em->neses[nesNum]->filterAudio;
+					em->SaveIni();
+				}
+				else if (InRange(id, IDM_NESOFFSET_RECORDSTEMS))
+				{
+					// Record stems
+					em->ToggleStemRecording(nesNum);
+				}
 				else if (InRange(id, IDM_NESOFFSET_OPENROM))
 				{
 					// Open ROM
@@ -1131,7 +1188,23 @@ void Emulator::UpdateMenu()
 		NewMenu(L"Pause\tCtrl+P", IDM_EMU_PAUSE, true, !MainNes()->running ? MF_CHECKED : MF_UNCHECKED);
 		NewMenu(L"Pause On Focus Loss", IDM_EMU_PAUSEONFOCUSLOST, true, pauseOnFocusLost ? MF_CHECKED : MF_UNCHECKED);
 		NewMenu(L"Capture External Input", IDM_EMU_EXTERNALINPUT, true, captureExternalInput ? MF_CHECKED : MF_UNCHECKED);
+		SubMenu(L"Sample Rate");
+		{
+			NewMenu(L"44100 Hz", IDM_EMU_SAMPLERATE44100, true, sampleRate == 44100 ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(L"48000 Hz", IDM_EMU_SAMPLERATE48000, true, sampleRate == 48000 ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(L"96000 Hz", IDM_EMU_SAMPLERATE96000, true, sampleRate == 96000 ? MF_CHECKED : MF_UNCHECKED);
+			EndSubMenu();
+		}
+		SubMenu(L"Run Ahead");
+		{
+			NewMenu(L"Off", IDM_EMU_RUNAHEAD0, true, runAheadFrames == 0 ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(L"1 Frame", IDM_EMU_RUNAHEAD1, true, runAheadFrames == 1 ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(L"2 Frames", IDM_EMU_RUNAHEAD2, true, runAheadFrames == 2 ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(L"3 Frames", IDM_EMU_RUNAHEAD3, true, runAheadFrames == 3 ? MF_CHECKED : MF_UNCHECKED);
+			EndSubMenu();
+		}
 		NewSeparator();
+		NewMenu(L"Netplay", IDM_EMU_NETPLAY, MainNes()->cart != nullptr, netplay ? MF_CHECKED : MF_UNCHECKED);
 		NewMenu(L"Add Emulator\tCtrl+N", IDM_EMU_ADDNES, neses.size() < MAX_EMULATORS);
 		EndSubMenu();
 	}
@@ -1259,6 +1332,13 @@ void Emulator::UpdateMenu()
 				EndSubMenu();
 			}
 			NewMenu(L"Mute", GetNesMenuID(nes, IDM_NESOFFSET_MUTE), true, neses[nes]->mute ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(L"Hardware Audio Filter", GetNesMenuID(nes, IDM_NESOFFSET_FILTER), true, neses[nes]->filterAudio ? MF_CHECKED : MF_UNCHECKED);
+			NewMenu(
+				L"Record Audio Stems",
+				GetNesMenuID(nes, IDM_NESOFFSET_RECORDSTEMS),
+				specificRomOpen || neses[nes]->IsRecordingStems(),
+				neses[nes]->IsRecordingStems() ? MF_CHECKED : MF_UNCHECKED
+			);
 			NewSeparator();
 			NewMenu(L"Delete Nes", GetNesMenuID(nes, IDM_NESOFFSET_REMOVE), neses.size() > 1);
 			EndSubMenu();
@@ -1355,11 +1435,76 @@ void Emulator::LoadExternalData()
 					// Mute
 					nes->mute = lines[n + 3] == L"mute";
 
+					// Audio filter
+					nes->filterAudio = n + 4 < lines.size() && lines[n + 4] == L"filter";
+
 					neses.push_back(std::move(nes));
 					if (neses.size() >= MAX_EMULATORS && !unlimitedEmulators)
 						break;
 				}
 
+			// Audio
+			for (size_t n = 1; n < lines.size(); n++)
+				if (lines[n - 1] == L"[audio]")
+				{
+					unsigned int rate = 0;
+					if (StringToUint(lines[n], rate) && AudioSink::IsSupportedSampleRate((int)rate))
+						sampleRate = (int)rate;
+					if (audio && audio->GetSampleRate() != sampleRate)
+						CreateAudio();
+					break;
+				}
+
+			// Rewind
+			for (size_t n = 1; n + 1 < lines.size(); n++)
+				if (lines[n - 1] == L"[rewind]")
+				{
+					unsigned int budget = 0;
+					if (StringToUint(lines[n], budget))
+						rewindBudgetMb = budget;
+					unsigned int interval = 0;
+					if (StringToUint(lines[n + 1], interval) && interval > 0)
+						rewindInterval = (int)interval;
+					break;
+				}
+
+			// Run ahead
+			for (size_t n = 1; n < lines.size(); n++)
+				if (lines[n - 1] == L"[run ahead]")
+				{
+					unsigned int frames = 0;
+					if (StringToUint(lines[n], frames) && frames <= Nes::MAX_RUN_AHEAD)
+						runAheadFrames = (int)frames;
+					break;
+				}
+
+			// Resume
+			for (size_t n = 1; n < lines.size(); n++)
+				if (lines[n - 1] == L"[resume]")
+				{
+					resumeOnStart = lines[n] != L"no_resume";
+					break;
+				}
+
+			// Netplay
+			for (size_t n = 1; n + 4 < lines.size(); n++)
+				if (lines[n - 1] == L"[netplay]")
+				{
+					unsigned int player = 0;
+					if (StringToUint(lines[n], player) && (player == 1 || player == 2))
+						netplaySettings.player = (int)player - 1;
+					unsigned int port = 0;
+					if (StringToUint(lines[n + 1], port) && port <= 0xFFFF)
+						netplaySettings.localPort = port;
+					netplaySettings.remoteHost = lines[n + 2];
+					if (StringToUint(lines[n + 3], port) && port <= 0xFFFF)
+						netplaySettings.remotePort = port;
+					unsigned int delay = 0;
+					if (StringToUint(lines[n + 4], delay) && delay <= NetplaySession::MAX_FRAME_DELAY)
+						netplaySettings.frameDelay = (int)delay;
+					break;
+				}
+
 			// Global data
 			for (size_t n = 1; n + 7 < lines.size(); n++)
 				if (lines[n - 1] == L"[global]")
@@ -1383,31 +1528,14 @@ void Emulator::LoadExternalData()
 					StringToUint(lines[n + 7], debugPage);
 				}
 		}
-
-		// Get save states
-		for (size_t i = 0; i < MAX_SAVES; i++)
-		{
-			saveStates[i] = L"";
-			std::ifstream f(exeDir + SAVE_FILENAME + std::to_wstring(i));
-
-			if (!f.is_open())
-				continue;
-
-			size_t strLen = 0;
-			f.read((char*)&strLen, sizeof(strLen));
-			if (f.eof() || f.fail() || f.bad() || strLen > 255)
-				continue;
-
-			std::wstring str;
-			str.resize(strLen);
-			f.read((char*)str.data(), strLen * sizeof(wchar_t));
-			if (f.eof() || f.fail() || f.bad())
-				continue;
-
-			saveStates[i] = str;
-		}
 	}
 
+	// The slots are read in the background and fill in the menu as they
+	// arrive
+	saveStore = std::make_unique<SaveStateStore>(exeDir + SAVE_FILENAME, MAX_SAVES, std::make_shared<ChunkStore>(exeDir + SAVE_DIR));
+	for (size_t i = 0; i < MAX_SAVES; i++)
+		saveStore->Prefetch((int)i);
+
 	// Default controller
 	if (controllers.empty())
 	{
@@ -1428,6 +1556,9 @@ void Emulator::LoadExternalData()
 		MainNes()->SetController(0, std::make_unique<Controller>(controllers.front(), input));
 	}
 
+	if (resumeOnStart)
+		LoadResumeStates();
+
 	if (neses.size() > 1)
 		for (size_t i = 1; i < neses.size(); i++)
 			neses[i]->StartAsync();
@@ -1453,7 +1584,9 @@ void Emulator::CreateAudio()
 {
 	try
 	{
-		audio = std::make_unique<Audio>(Emulator::AudioRequest);
+		audio.reset();
+		Apu::SetSampleRate(sampleRate);
+		audio = std::make_unique<WaveOutSink>(Emulator::AudioRequest, nullptr, sampleRate);
 	}
 	catch (AudioException&)
 	{
@@ -1467,6 +1600,104 @@ void Emulator::CreateAudio()
 	}
 }
 
+void Emulator::SetSampleRate(int rate)
+{
+	if (!AudioSink::IsSupportedSampleRate(rate) || rate == sampleRate)
+		return;
+
+	sampleRate = rate;
+	if (audio)
+		CreateAudio();
+	else
+		Apu::SetSampleRate(sampleRate);
+	UpdateMenu();
+	SaveIni();
+}
+
+void Emulator::StartNetplay(const NetplaySettings& settings)
+{
+	StopNetplay();
+	if (!MainNes()->cart)
+		return;
+
+	try
+	{
+		std::string host(settings.remoteHost.begin(), settings.remoteHost.end());
+		netplay = std::make_unique<NetplaySession>(
+			*MainNes(),
+			settings.player,
+			(uint16_t)settings.localPort,
+			host,
+			(uint16_t)settings.remotePort,
+			settings.frameDelay
+		);
+	}
+	catch (NetworkException& ex)
+	{
+		MessageBoxA(hWnd, ex.what(), "Netplay Error", MB_OK | MB_ICONERROR);
+	}
+	catch (EmuFileException& ex)
+	{
+		MessageBoxA(hWnd, ex.what(), "File Error", MB_OK | MB_ICONERROR);
+	}
+	UpdateMenu();
+}
+
+void Emulator::StopNetplay()
+{
+	if (!netplay)
+		return;
+	netplay.reset();
+	UpdateMenu();
+}
+
+int Emulator::GetAudioLatencyMs() const
+{
+	if (!audio)
+		return 0;
+
+	// Device queue plus the fullest emulator queue
+	int apuLatency = 0;
+	for (const auto& nes : neses)
+	{
+		auto apu = nes->apu;
+		if (apu)
+			apuLatency = std::max(apuLatency, apu->GetLatencyMs());
+	}
+	return audio->GetLatencyMs() + apuLatency;
+}
+
+void Emulator::ToggleStemRecording(int nes)
+{
+	if (neses[nes]->IsRecordingStems())
+	{
+		neses[nes]->StopStemRecording();
+	}
+	else if (neses[nes]->cart)
+	{
+		// Recordings are named after the rom and the time they started
+		wchar_t timeText[32]{};
+		std::time_t now = std::time(nullptr);
+		std::tm local{};
+		localtime_s(&local, &now);
+		std::wcsftime(timeText, std::size(timeText), L"%Y-%m-%d %H-%M-%S", &local);
+
+		std::wstring dir = exeDir + RECORDINGS_DIR;
+		std::error_code ec;
+		std::filesystem::create_directory(dir, ec);
+		std::wstring romName = std::filesystem::path(neses[nes]->cart->filename).stem().wstring();
+		try
+		{
+			neses[nes]->StartStemRecording(dir + L"/" + romName + L" " + timeText + L".wav");
+		}
+		catch (EmuFileException& ex)
+		{
+			MessageBoxA(hWnd, ex.what(), "File Error", MB_OK | MB_ICONERROR);
+		}
+	}
+	UpdateMenu();
+}
+
 void Emulator::SaveFile(const std::vector<uint8_t>& bytes) const
 {
 	OPENFILENAMEW diagDesc{};
@@ -1499,6 +1730,7 @@ void Emulator::SaveFile(const std::vector<uint8_t>& bytes) const
 
 void Emulator::OpenAllROM(const std::wstring& filename)
 {
+	StopNetplay();
 	try
 	{
 		for (size_t i = 0; i < neses.size(); i++)
@@ -1519,6 +1751,8 @@ void Emulator::OpenAllROM(const std::wstring& filename)
 
 void Emulator::OpenROM(int nes, const std::wstring& filename)
 {
+	if (nes == 0)
+		StopNetplay();
 	try
 	{
 		neses[nes]->InsertCartridge(std::make_shared<Cartridge>(
@@ -1593,55 +1827,56 @@ void Emulator::DeleteRecentRom(std::wstring rom)
 
 void Emulator::CheckSaveStates()
 {
+	SaveStateStore::Completion done;
+	bool slotsChanged = false;
+	while (saveStore->PollCompletion(done))
+	{
+		if (done.ok)
+		{
+			saveStates[done.slot] = done.romFilename;
+			slotsChanged = true;
+		}
+		else if (done.write)
+		{
+			MessageBoxW(
+				hWnd,
+				(L"Could not write save state " + std::to_wstring(done.slot) + L" to: " + SAVE_DIR).c_str(),
+				L"File Error",
+				MB_OK | MB_ICONERROR
+			);
+		}
+	}
+	if (slotsChanged)
+		UpdateMenu();
+
 	for (auto& nes : neses)
 	{
 		int state = nes->saveLoadState;
 		if (state > 0)
 		{
-			// Save
+			// Save, the file is written in the background
 			nes->saveLoadState = 0;
 			int slot = state - 1;
-
-			std::error_code ec;
-			std::filesystem::create_directory(exeDir + SAVE_DIR, ec);
-
-			std::ofstream f(exeDir + SAVE_FILENAME + std::to_wstring(slot), std::ios::binary);
-			if (f.is_open())
-			{
-				auto bytes = nes->SaveState();
-				f.write(reinterpret_cast<char*>(bytes.data()), bytes.size());
-			}
-
-			if (!f.is_open() || f.fail() || f.bad())
-			{
-				MessageBoxW(
-					hWnd,
-					(L"Could not write to file: " + SAVE_FILENAME + std::to_wstring(slot)).c_str(),
-					L"File Error",
-					MB_OK | MB_ICONERROR
-				);
-				return;
-			}
-			saveStates[slot] = nes->cart->filename;
-			UpdateMenu();
+			saveStore->Save(slot, nes->cart->filename, nes->SaveState());
 		}
 		else if (state < 0)
 		{
-			// Load
-			nes->saveLoadState = 0;
-			int slot = -state - 1;
-			std::ifstream f(exeDir + SAVE_FILENAME + std::to_wstring(slot), std::ios::binary | std::ios::ate);
-
-			std::vector<uint8_t> bytes;
-			if (f.is_open())
+			// Load, except into a netplay session which the peer couldn't follow
+			if (netplay && nes == MainNes())
 			{
-				size_t len = (size_t)f.tellg();
-				f.seekg(0, std::ios::beg);
-				bytes.resize(len);
-				f.read(reinterpret_cast<char*>(bytes.data()), len);
+				nes->saveLoadState = 0;
+				continue;
 			}
 
-			if (!f.is_open() || f.fail() || f.bad())
+			// A slot that is still being read is tried again next frame
+			int slot = -state - 1;
+			std::wstring romFilename;
+			std::shared_ptr<const Snapshot> bytes;
+			if (!saveStore->Get(slot, romFilename, bytes))
+				continue;
+			nes->saveLoadState = 0;
+
+			if (!bytes)
 			{
 				MessageBoxW(
 					hWnd,
@@ -1654,7 +1889,7 @@ void Emulator::CheckSaveStates()
 
 			try
 			{
-				nes->LoadState(saveStates[slot], bytes);
+				nes->LoadState(romFilename, *bytes);
 			}
 			catch (EmuFileException&)
 			{
@@ -1671,17 +1906,118 @@ void Emulator::CheckSaveStates()
 	}
 }
 
+void Emulator::SaveResumeStates()
+{
+	// Each file holds the rom's path and then the state, like a save slot.
+	// A nes without a cartridge removes its file so it starts empty.
+	std::error_code ec;
+	std::filesystem::create_directories(exeDir + SAVE_DIR, ec);
+	for (size_t i = 0; i < neses.size(); i++)
+	{
+		std::wstring path = exeDir + RESUME_FILENAME + std::to_wstring(i);
+		if (!neses[i]->cart)
+		{
+			std::filesystem::remove(path, ec);
+			continue;
+		}
+
+		// The other neses run on their own threads until stopped
+		if (neses[i]->thrd.joinable())
+			neses[i]->StopAsync();
+		Snapshot snapshot;
+		StateWriter bytes(snapshot);
+		const std::wstring& romFilename = neses[i]->cart->filename;
+		SaveBytes(bytes, romFilename.size());
+		SaveBytes(bytes, romFilename.data(), romFilename.size());
+		neses[i]->SaveState(bytes);
+
+		// Renamed into place so that a failed write keeps the last one
+		std::wstring temp = path + L".tmp";
+		std::ofstream f(temp, std::ios::binary);
+		f.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+		f.close();
+		if (f.fail())
+			std::filesystem::remove(temp, ec);
+		else
+			std::filesystem::rename(temp, path, ec);
+	}
+
+	// Neses that have since been removed
+	size_t removed = neses.size();
+	while (std::filesystem::remove(exeDir + RESUME_FILENAME + std::to_wstring(removed), ec))
+		removed++;
+}
+
+void Emulator::LoadResumeStates()
+{
+	// States are read straight out of a mapping of the file, so resuming
+	// costs about as much as opening the rom. Each file is removed once it
+	// has been read, loaded or not, so that only a clean exit leaves one.
+	// Otherwise a crash would resume a state whose sram is older than what
+	// has been journaled since, and the next journal would write over it.
+	for (size_t i = 0; i < neses.size(); i++)
+	{
+		std::wstring path = exeDir + RESUME_FILENAME + std::to_wstring(i);
+		std::error_code ec;
+		if (!std::filesystem::exists(path, ec))
+			continue;
+		try
+		{
+			auto file = std::make_shared<const MappedFile>(path);
+			StateReader bytes(file->Data(), file->Size());
+			size_t strLen = 0;
+			LoadBytes(bytes, strLen);
+			if (strLen > bytes.Remaining() / sizeof(wchar_t))
+				throw EmuFileException("invalid file");
+			std::wstring romFilename(strLen, L'\0');
+			LoadBytes(bytes, romFilename.data(), strLen);
+			neses[i]->LoadState(romFilename, StateContainer::Open(file, file->Size() - bytes.Remaining()));
+			if (i == 0)
+				InsertRecentRom(romFilename);
+		}
+		catch (EmuFileException&)
+		{
+			// Starts empty, as if there was no file
+		}
+		// The mapping is closed by now, so the file can be removed
+		std::filesystem::remove(path, ec);
+	}
+}
+
 bool Emulator::Run(std::wstring cmdArgs)
 {
 	em = this;
 	int prevFps = fps;
+	int prevLatency = -1;
+	int prevFrameTime = -1;
+	std::wstring prevNetplayText;
 	MSG msg{};
 
+	// A session can be started from the command line, as in
+	// --netplay <player> <local port> <remote host> <remote port> <rom>,
+	// so that two instances can be launched against each other
+	std::optional<NetplaySettings> cmdNetplay;
+	if (cmdArgs.rfind(L"--netplay ", 0) == 0)
+	{
+		std::wistringstream args(cmdArgs.substr(10));
+		NetplaySettings settings = netplaySettings;
+		unsigned int player = 0;
+		if (args >> player >> settings.localPort >> settings.remoteHost >> settings.remotePort
+			&& (player == 1 || player == 2) && settings.localPort <= 0xFFFF && settings.remotePort <= 0xFFFF)
+		{
+			settings.player = (int)player - 1;
+			cmdNetplay = settings;
+		}
+		std::getline(args >> std::ws, cmdArgs);
+	}
+
 	if (!cmdArgs.empty())
 	{
 		if (cmdArgs.size() >= 2 && cmdArgs.front() == '"' && cmdArgs.back() == '"')
 			cmdArgs = cmdArgs.substr(1, cmdArgs.size() - 2);
 		OpenROM(0, cmdArgs);
+		if (cmdNetplay && MainNes()->cart)
+			StartNetplay(*cmdNetplay);
 	}
 
 	while (true)
@@ -1710,17 +2046,43 @@ bool Emulator::Run(std::wstring cmdArgs)
 			input.UpdateKeys(focus || captureExternalInput);
 			Update();
 
-			if (prevFps != fps)
+			// Latency jitters every frame so only refresh it once a second
+			bool refresh = frameCount % 60 == 0;
+			int latency = refresh ? GetAudioLatencyMs() : prevLatency;
+			int frameTime = !runAheadFrames ? -1
+				: refresh ? (int)(MainNes()->GetFrameTimeMs() * 10.0f + 0.5f) : prevFrameTime;
+			std::wstring netplayText;
+			if (netplay)
+			{
+				netplayText = L", netplay player " + std::to_wstring(netplay->GetPlayer() + 1);
+				if (netplay->IsDesynced())
+					netplayText += L", desynced at frame " + std::to_wstring(netplay->GetDesyncFrame());
+				else if (netplay->IsWaiting())
+					netplayText += L", waiting";
+			}
+			if (prevFps != fps || prevLatency != latency || prevFrameTime != frameTime || prevNetplayText != netplayText)
 			{
-				SetWindowTextW(hWnd, (title + std::to_wstring(fps) + L" fps").c_str());
+				std::wstring text = title + std::to_wstring(fps) + L" fps";
+				if (audio)
+					text += L", " + std::to_wstring(latency) + L" ms audio latency";
+				if (frameTime >= 0)
+					text += L", " + std::to_wstring(frameTime / 10) + L"." + std::to_wstring(frameTime % 10) + L" ms/frame";
+				text += netplayText;
+				SetWindowTextW(hWnd, text.c_str());
 				prevFps = fps;
+				prevLatency = latency;
+				prevFrameTime = frameTime;
+				prevNetplayText = netplayText;
 			}
 		}
 		else
 			Sleep(10);
 	}
 end:
+	netplay.reset();
 	SaveIni();
+	if (resumeOnStart)
+		SaveResumeStates();
 	audio.reset();
 	neses.clear();
 	em = nullptr;
@@ -1743,6 +2105,31 @@ void Emulator::SaveIni() const
 	f << (int)debug << std::endl;
 	f << debugPage << std::endl;
 
+	// Audio
+	f << L"[audio]" << std::endl;
+	f << sampleRate << std::endl;
+
+	// Rewind
+	f << L"[rewind]" << std::endl;
+	f << rewindBudgetMb << std::endl;
+	f << rewindInterval << std::endl;
+
+	// Run ahead
+	f << L"[run ahead]" << std::endl;
+	f << runAheadFrames << std::endl;
+
+	// Resume
+	f << L"[resume]" << std::endl;
+	f << (resumeOnStart ? L"resume" : L"no_resume") << std::endl;
+
+	// Netplay
+	f << L"[netplay]" << std::endl;
+	f << (netplaySettings.player + 1) << std::endl;
+	f << netplaySettings.localPort << std::endl;
+	f << netplaySettings.remoteHost << std::endl;
+	f << netplaySettings.remotePort << std::endl;
+	f << netplaySettings.frameDelay << std::endl;
+
 	// Recent ROMs
 	f << L"[recent roms]" << std::endl;
 	for (const auto& rom : recentRoms)
@@ -1780,6 +2167,7 @@ void Emulator::SaveIni() const
 		}
 		f << (nes->GetEmulationSpeed() + 8) << std::endl;
 		f << (nes->mute ? L"mute" : L"unmute") << std::endl;
+		f << (nes->filterAudio ? L"filter" : L"no_filter") << std::endl;
 	}
 }
 
@@ -1970,10 +2358,33 @@ void Emulator::Update()
 				}
 				CheckSaveStates();
 
+				// Hold backspace to rewind
+				bool rewinding = input.GetKey(Key::BackSpace);
 				for (auto& nes : neses)
+				{
+					nes->headless = !audio;
+					nes->rewinding = rewinding;
+					nes->rewindBudget = rewindBudgetMb * 1024 * 1024;
+					nes->rewindInterval = rewindInterval;
+					nes->runAhead = runAheadFrames;
 					nes->frameComplete = false;
+				}
 
-				MainNes()->DoIteration();
+				// Either port's keys can be used to play over netplay
+				if (netplay)
+				{
+					try
+					{
+						netplay->Update(MainNes()->controllers[0]->Poll() | MainNes()->controllers[1]->Poll());
+					}
+					catch (NetworkException& ex)
+					{
+						StopNetplay();
+						MessageBoxA(hWnd, ex.what(), "Netplay Error", MB_OK | MB_ICONERROR);
+					}
+				}
+				else
+					MainNes()->DoIteration();
 			}
 
 			if (debug != DebugState::None)
@@ -2220,9 +2631,11 @@ void Emulator::DrawRam()
 		int val = input.GetHexKeyPressed();
 		if (val != -1)
 		{
-			uint8_t& b = MainNes()->ram[debugPage * 256 + ramAddr / 2];
+			size_t addr = debugPage * 256 + ramAddr / 2;
+			uint8_t b = MainNes()->ram[addr];
 			b &= ramAddr % 2 ? 0xF0 : 0x0F;
 			b |= ramAddr % 2 ? val : (val << 4);
+			MainNes()->ram.Write(addr, b);
 			ramAddr = (ramAddr + 1) % 512;
 		}
 	}
@@ -2263,16 +2676,14 @@ void Emulator::DrawCpu()
 		{
 			decltype(Cpu::status) status;
 			uint32_t pc;
-			uint8_t* ram;
+			uint8_t ram[0x200];
 			uint8_t ra, rx, ry, sp;
 		} cpu{};
-		uint8_t buf[0x102]{};
-		cpu.ram = buf;
 		if (MainNes()->cart)
 		{
 			cpu.status = MainNes()->cpu->status;
 			cpu.pc = MainNes()->cpu->pc;
-			cpu.ram = MainNes()->ram;
+			MainNes()->ram.Read(0, cpu.ram, std::size(cpu.ram));
 			cpu.ra = MainNes()->cpu->ra;
 			cpu.rx = MainNes()->cpu->rx;
 			cpu.ry = MainNes()->cpu->ry;
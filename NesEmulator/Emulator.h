@@ -4,7 +4,9 @@
 #include "Graphics.h"
 #include "Nes.h"
 #include "Input.h"
-#include "Audio.h"
+#include "WaveOutSink.h"
+#include "NetplaySession.h"
+#include "SaveStateStore.h"
 
 class Emulator
 {
@@ -49,6 +51,8 @@ private:
 	void UpdateMenu();
 	void CheckKeyboardShortcuts();
 	void CheckSaveStates();
+	void SaveResumeStates();
+	void LoadResumeStates();
 	void RepositionNeses();
 	void SetFullscreenState(bool fullscreen);
 	static bool OpenROMDialog(std::wstring& outFile);
@@ -61,6 +65,9 @@ private:
 	bool Debuggable() const;
 	void ChangeDebugState(DebugState ds);
 	void CreateAudio();
+	void ToggleStemRecording(int nes);
+	void SetSampleRate(int rate);
+	int GetAudioLatencyMs() const;
 	static bool StringToUint(std::wstring s, unsigned int& out);
 	static std::wstring GetFilenameFromPath(const std::wstring& path);
 	static void AudioRequest(float* out);
@@ -69,6 +76,8 @@ private:
 	static const std::wstring INI_FILENAME;
 	static const std::wstring SAVE_FILENAME;
 	static const std::wstring SAVE_DIR;
+	static const std::wstring RESUME_FILENAME;
+	static const std::wstring RECORDINGS_DIR;
 	static constexpr size_t MAX_RECENTROMS = 10;
 	static constexpr size_t MAX_SAVES = 10;
 	static constexpr size_t MAX_CONTROLLERS = 8;
@@ -76,6 +85,7 @@ private:
 	static size_t MAX_EMULATORS;
 	std::vector<std::wstring> recentRoms;
 	std::wstring saveStates[MAX_SAVES];
+	std::unique_ptr<SaveStateStore> saveStore;
 	std::vector<std::unique_ptr<ControllerTemplate>> controllers;
 
 	WndState prevWndState = WndState::Restored;
@@ -106,12 +116,37 @@ private:
 	// Audio
 	std::atomic_bool multithreaded = true;
 	std::atomic_bool mute = false;
+	int sampleRate = AudioSink::DEFAULT_SAMPLE_RATE;
+	std::vector<float> mixBuffer;
+
+	// Rewind, memory per nes in MiB and frames between captures
+	size_t rewindBudgetMb = Nes::DEFAULT_REWIND_BUDGET / (1024 * 1024);
+	int rewindInterval = Nes::DEFAULT_REWIND_INTERVAL;
+
+	// Run ahead, frames emulated past the real state each host frame
+	int runAheadFrames = 0;
+
+	// Resume, each nes is saved on exit and carries on from there at startup
+	bool resumeOnStart = true;
+
+	// Netplay, while a session is running it drives the main nes
+	struct NetplaySettings
+	{
+		int player = 0;
+		unsigned int localPort = 7000;
+		std::wstring remoteHost = L"127.0.0.1";
+		unsigned int remotePort = 7001;
+		int frameDelay = NetplaySession::DEFAULT_FRAME_DELAY;
+	} netplaySettings;
+	std::unique_ptr<NetplaySession> netplay;
+	void StartNetplay(const NetplaySettings& settings);
+	void StopNetplay();
 
 	// Devices
 	static constexpr size_t MAX_NESES = 8;
 	std::vector<std::unique_ptr<Nes>> neses;
 	std::unique_ptr<Graphics> gfx;
-	std::unique_ptr<Audio> audio;
+	std::unique_ptr<AudioSink> audio;
 	Input input;
 	std::unique_ptr<Nes>& MainNes();
 	const std::unique_ptr<Nes>& MainNes() const;
@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+#include "EmuFileException.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <filesystem>
+#endif
+
+MappedFile::MappedFile(const std::wstring& filename)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw EmuFileException("could not open file");
+
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		throw EmuFileException("error reading file");
+	}
+
+	// Empty files can't be mapped, leave them as an empty mapping
+	if (fileSize.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		// The view keeps the mapping and file alive by itself
+		if (mapping)
+			CloseHandle(mapping);
+		if (!view)
+		{
+			CloseHandle(file);
+			throw EmuFileException("error reading file");
+		}
+		data = static_cast<const uint8_t*>(view);
+		size = (size_t)fileSize.QuadPart;
+	}
+	CloseHandle(file);
+#else
+	int fd = open(std::filesystem::path(filename).c_str(), O_RDONLY);
+	if (fd < 0)
+		throw EmuFileException("could not open file");
+
+	struct stat st{};
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw EmuFileException("error reading file");
+	}
+
+	if (st.st_size > 0)
+	{
+		void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			close(fd);
+			throw EmuFileException("error reading file");
+		}
+		data = static_cast<const uint8_t*>(view);
+		size = (size_t)st.st_size;
+	}
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	if (!data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap(const_cast<uint8_t*>(data), size);
+#endif
+}
+
+const uint8_t* MappedFile::Data() const
+{
+	return data;
+}
+
+size_t MappedFile::Size() const
+{
+	return size;
+}
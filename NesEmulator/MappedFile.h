@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::wstring& filename);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+	const uint8_t* Data() const;
+	size_t Size() const;
+private:
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
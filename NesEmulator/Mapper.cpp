@@ -1,32 +1,38 @@
 #include "Mapper.h"
 #include "EmuFileException.h"
+#include "Hash.h"
 #include <fstream>
 
-Mapper::Mapper(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	prgChunks(prgChunks),
-	chrChunks(chrChunks),
-	mapperNumber(mapperNumber),
+Mapper::Mapper(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	prg(prg),
-	chr(chr)
+	chr(chr),
+	mapperNumber(mapperNumber),
+	prgChunks(prgChunks),
+	chrChunks(chrChunks)
 {
 }
 
-Mapper::Mapper(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	prg(prg),
-	chr(chr)
+void Mapper::LoadState(StateReader& bytes)
 {
 	LoadBytes(bytes, mapperNumber);
 	LoadBytes(bytes, prgChunks);
 	LoadBytes(bytes, chrChunks);
 }
 
-Snapshot Mapper::SaveState() const
+void Mapper::SaveState(StateWriter& bytes) const
 {
-	std::vector<uint8_t> bytes;
 	SaveBytes(bytes, mapperNumber);
 	SaveBytes(bytes, prgChunks);
 	SaveBytes(bytes, chrChunks);
-	return bytes;
+}
+
+uint64_t Mapper::HashState(uint64_t hash) const
+{
+	// Only a few registers, so they go through a saved state
+	Snapshot registers;
+	StateWriter bytes(registers);
+	SaveState(bytes);
+	return HashBytes(registers.data(), registers.size(), hash);
 }
 
 void Mapper::Reset()
@@ -66,7 +72,7 @@ bool Mapper::MapCpuWrite(uint32_t addr, uint8_t data)
 	{
 		addr -= 0x8000;
 		if (addr < prg.size())
-			prg[addr] = data;
+			prg.Write(addr, data);
 		return true;
 	}
 	return false;
@@ -88,7 +94,7 @@ bool Mapper::MapPpuWrite(uint16_t& addr, uint8_t data)
 	if (addr < 0x2000)
 	{
 		if (addr < chr.size())
-			chr[addr] = data;
+			chr.Write(addr, data);
 		return true;
 	}
 	return false;
@@ -112,7 +118,7 @@ void Mapper::CountScanline()
 {
 }
 
-const std::vector<uint8_t>* Mapper::GetSRam() const
+const PagedMemory* Mapper::GetSRam() const
 {
 	return nullptr;
 }
@@ -120,3 +126,8 @@ const std::vector<uint8_t>* Mapper::GetSRam() const
 void Mapper::SetSRam(const std::vector<uint8_t>& data)
 {
 }
+
+std::unique_ptr<Mapper> Mapper::Fork(RomView& prg, RomView& chr) const
+{
+	return nullptr;
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdint>
+#include <memory>
 #include <vector>
+#include "RomView.h"
+#include "PagedMemory.h"
 #include "SaveStateUtil.h"
 
 enum class MirrorMode
@@ -17,7 +20,10 @@ class Mapper
 	friend class Emulator;
 public:
 	virtual ~Mapper() = default;
-	virtual Snapshot SaveState() const;
+	virtual void LoadState(StateReader& bytes);
+	virtual void SaveState(StateWriter& bytes) const;
+	// Hash of the same state that SaveState writes
+	virtual uint64_t HashState(uint64_t hash) const;
 	int MapperNumber() const;
 
 	virtual bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false);
@@ -29,15 +35,39 @@ public:
 	virtual bool GetIrq() const;
 	virtual void ClearIrq();
 	virtual void CountScanline();
-	virtual const std::vector<uint8_t>* GetSRam() const;
+	virtual const PagedMemory* GetSRam() const;
 	virtual void SetSRam(const std::vector<uint8_t>& data);
+	// Copy of the mapper working on another cartridge's views, or null if
+	// this mapper can't be copied
+	virtual std::unique_ptr<Mapper> Fork(RomView& prg, RomView& chr) const;
 protected:
-	Mapper(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	// One of the cartridge's views, which a fork points at its own copy
+	class ViewRef
+	{
+	public:
+		ViewRef(RomView& view) : view(&view) {}
+		uint8_t operator[](size_t index) const { return (*view)[index]; }
+		size_t size() const { return view->size(); }
+		void Write(size_t index, uint8_t value) { view->Write(index, value); }
+		ViewRef& operator=(RomView&& other) { *view = std::move(other); return *this; }
+		void Rebind(RomView& other) { view = &other; }
+	private:
+		RomView* view;
+	};
+
+	Mapper(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr);
 	bool MapCpuRead(uint32_t addr, uint8_t& data);
 	bool MapCpuWrite(uint32_t addr, uint8_t data);
-	std::vector<uint8_t>& prg;
-	std::vector<uint8_t>& chr;
+	template <class T>
+	std::unique_ptr<Mapper> ForkAs(RomView& prg, RomView& chr) const
+	{
+		std::unique_ptr<Mapper> fork = std::make_unique<T>(static_cast<const T&>(*this));
+		fork->prg.Rebind(prg);
+		fork->chr.Rebind(chr);
+		return fork;
+	}
+	ViewRef prg;
+	ViewRef chr;
 	int mapperNumber;
 	int prgChunks;
 	int chrChunks;
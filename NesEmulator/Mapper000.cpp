@@ -1,15 +1,10 @@
 #include "Mapper000.h"
 
-Mapper000::Mapper000(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper000::Mapper000(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr)
 {
 }
 
-Mapper000::Mapper000(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr)
-{
-}
-
 bool Mapper000::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly)
 {
 	uint32_t newAddr;
@@ -24,3 +19,8 @@ bool Mapper000::MapCpuWrite(uint16_t& addr, uint8_t data)
 {
 	return false;
 }
+
+std::unique_ptr<Mapper> Mapper000::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper000>(prg, chr);
+}
@@ -1,35 +1,48 @@
 #include "Mapper001.h"
+#include <algorithm>
+#include "Hash.h"
 
-Mapper001::Mapper001(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper001::Mapper001(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
 	sram(0x2000)
 {
 	Reset();
 }
 
-Mapper001::Mapper001(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr),
-	sram(0x2000)
+void Mapper001::LoadState(StateReader& bytes)
 {
+	Mapper::LoadState(bytes);
 	LoadBytes(bytes, shift);
 	LoadBytes(bytes, chrLo);
 	LoadBytes(bytes, chrHi);
 	LoadBytes(bytes, prgLo);
 	LoadBytes(bytes, ctrl);
-	LoadBytes(bytes, sram.data(), sram.size());
+	sram.LoadState(bytes);
+}
+
+void Mapper001::SaveState(StateWriter& bytes) const
+{
+	Mapper::SaveState(bytes);
+	SaveRegisters(bytes);
+	sram.SaveState(bytes);
+}
+
+uint64_t Mapper001::HashState(uint64_t hash) const
+{
+	Snapshot registers;
+	StateWriter bytes(registers);
+	Mapper::SaveState(bytes);
+	SaveRegisters(bytes);
+	return sram.Hash(HashBytes(registers.data(), registers.size(), hash));
 }
 
-Snapshot Mapper001::SaveState() const
+void Mapper001::SaveRegisters(StateWriter& bytes) const
 {
-	Snapshot bytes;
-	AppendVector(bytes, Mapper::SaveState());
 	SaveBytes(bytes, shift);
 	SaveBytes(bytes, chrLo);
 	SaveBytes(bytes, chrHi);
 	SaveBytes(bytes, prgLo);
 	SaveBytes(bytes, ctrl);
-	AppendVector(bytes, sram);
-	return bytes;
 }
 
 void Mapper001::Reset()
@@ -95,7 +108,7 @@ bool Mapper001::MapCpuWrite(uint16_t& addr, uint8_t data)
 {
 	if (addr >= 0x6000 && addr < 0x8000)
 	{
-		sram[addr - 0x6000] = data;
+		sram.Write(addr - 0x6000, data);
 		return true;
 	}
 	else if (addr >= 0x8000)
@@ -172,19 +185,24 @@ bool Mapper001::MapPpuWrite(uint16_t& addr, uint8_t data)
 	if (MapPpuAddr(addr, newAddr))
 	{
 		if (newAddr < chr.size())
-			chr[newAddr] = data;
+			chr.Write(newAddr, data);
 		return true;
 	}
 	return false;
 }
 
-const std::vector<uint8_t>* Mapper001::GetSRam() const
+const PagedMemory* Mapper001::GetSRam() const
 {
 	return &sram;
 }
 
 void Mapper001::SetSRam(const std::vector<uint8_t>& data)
 {
-	sram = data;
-	sram.resize(0x2000);
+	sram.Fill(0);
+	sram.Write(0, data.data(), std::min(data.size(), sram.size()));
+}
+
+std::unique_ptr<Mapper> Mapper001::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper001>(prg, chr);
 }
@@ -4,18 +4,21 @@
 class Mapper001 : public Mapper
 {
 public:
-	Mapper001(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper001(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper001(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
 	bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapPpuWrite(uint16_t& addr, uint8_t data) override;
-	Snapshot SaveState() const override;
+	void LoadState(StateReader& bytes) override;
+	void SaveState(StateWriter& bytes) const override;
+	uint64_t HashState(uint64_t hash) const override;
 	void Reset() override;
 	MirrorMode GetMirrorMode() const override;
-	const std::vector<uint8_t>* GetSRam() const override;
+	const PagedMemory* GetSRam() const override;
 	void SetSRam(const std::vector<uint8_t>& data) override;
+	std::unique_ptr<Mapper> Fork(RomView& prg, RomView& chr) const override;
 private:
+	void SaveRegisters(StateWriter& bytes) const;
 	bool MapPpuAddr(uint16_t& addr, uint32_t& newAddr) const;
 	uint8_t shift;
 	uint8_t chrLo;
@@ -31,5 +34,5 @@ private:
 		};
 		uint8_t reg;
 	} ctrl;
-	std::vector<uint8_t> sram;
+	PagedMemory sram;
 };
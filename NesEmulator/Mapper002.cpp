@@ -1,15 +1,15 @@
 #include "Mapper002.h"
 
-Mapper002::Mapper002(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper002::Mapper002(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
 	loPrgBank(0),
 	hiPrgBank(prgChunks - 1)
 {
 }
 
-Mapper002::Mapper002(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr)
+void Mapper002::LoadState(StateReader& bytes)
 {
+	Mapper::LoadState(bytes);
 	LoadBytes(bytes, loPrgBank);
 	hiPrgBank = prgChunks - 1;
 }
@@ -19,12 +19,10 @@ void Mapper002::Reset()
 	loPrgBank = 0;
 }
 
-Snapshot Mapper002::SaveState() const
+void Mapper002::SaveState(StateWriter& bytes) const
 {
-	Snapshot bytes;
-	AppendVector(bytes, Mapper::SaveState());
+	Mapper::SaveState(bytes);
 	SaveBytes(bytes, loPrgBank);
-	return bytes;
 }
 
 bool Mapper002::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly)
@@ -48,3 +46,8 @@ bool Mapper002::MapCpuWrite(uint16_t& addr, uint8_t data)
 		loPrgBank = data;
 	return false;
 }
+
+std::unique_ptr<Mapper> Mapper002::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper002>(prg, chr);
+}
@@ -4,12 +4,13 @@
 class Mapper002 : public Mapper
 {
 public:
-	Mapper002(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper002(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper002(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
-	Snapshot SaveState() const override;
+	void LoadState(StateReader& bytes) override;
+	void SaveState(StateWriter& bytes) const override;
 	void Reset() override;
+	std::unique_ptr<Mapper> Fork(RomView& prg, RomView& chr) const override;
 private:
 	uint8_t loPrgBank;
 	uint8_t hiPrgBank;
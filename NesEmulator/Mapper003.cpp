@@ -1,23 +1,22 @@
 #include "Mapper003.h"
 
-Mapper003::Mapper003(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper003::Mapper003(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
 	chrBank(0)
 {
 }
 
-Mapper003::Mapper003(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr)
+void Mapper003::LoadState(StateReader& bytes)
 {
+	Mapper::LoadState(bytes);
 	LoadBytes(bytes, chrBank);
 	chrBank &= 0b11;
 }
 
-Snapshot Mapper003::SaveState() const
+void Mapper003::SaveState(StateWriter& bytes) const
 {
-	auto bytes = Mapper::SaveState();
+	Mapper::SaveState(bytes);
 	SaveBytes(bytes, chrBank);
-	return bytes;
 }
 
 void Mapper003::Reset()
@@ -60,3 +59,8 @@ bool Mapper003::MapPpuWrite(uint16_t& addr, uint8_t data)
 {
 	return false;
 }
+
+std::unique_ptr<Mapper> Mapper003::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper003>(prg, chr);
+}
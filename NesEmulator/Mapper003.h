@@ -4,14 +4,15 @@
 class Mapper003 : public Mapper
 {
 public:
-	Mapper003(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper003(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper003(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
 	bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapPpuWrite(uint16_t& addr, uint8_t data) override;
-	Snapshot SaveState() const override;
+	void LoadState(StateReader& bytes) override;
+	void SaveState(StateWriter& bytes) const override;
 	void Reset() override;
+	std::unique_ptr<Mapper> Fork(RomView& prg, RomView& chr) const override;
 private:
 	int chrBank;
 };
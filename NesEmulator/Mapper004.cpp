@@ -1,19 +1,20 @@
 #include "Mapper004.h"
+#include <algorithm>
+#include "Hash.h"
 
-Mapper004::Mapper004(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper004::Mapper004(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
-	sram(0x2000),
-	lastPrgBankNumber(prgChunks * 2 - 1)
+	lastPrgBankNumber(prgChunks * 2 - 1),
+	sram(0x2000)
 {
 	Reset();
 }
 
-Mapper004::Mapper004(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr),
-	sram(0x2000),
-	lastPrgBankNumber(prgChunks * 2 - 1)
+void Mapper004::LoadState(StateReader& bytes)
 {
-	LoadBytes(bytes, sram.data(), sram.size());
+	Mapper::LoadState(bytes);
+	lastPrgBankNumber = prgChunks * 2 - 1;
+	sram.LoadState(bytes);
 	LoadBytes(bytes, regs, std::size(regs));
 	LoadBytes(bytes, bankSelect);
 	LoadBytes(bytes, mirrorMode);
@@ -36,12 +37,25 @@ void Mapper004::Reset()
 	mirrorMode = MirrorMode::Hardwired;
 }
 
-Snapshot Mapper004::SaveState() const
+void Mapper004::SaveState(StateWriter& bytes) const
 {
-	Snapshot bytes;
-	AppendVector(bytes, Mapper::SaveState());
+	Mapper::SaveState(bytes);
 
-	SaveBytes(bytes, sram.data(), sram.size());
+	sram.SaveState(bytes);
+	SaveRegisters(bytes);
+}
+
+uint64_t Mapper004::HashState(uint64_t hash) const
+{
+	Snapshot registers;
+	StateWriter bytes(registers);
+	Mapper::SaveState(bytes);
+	SaveRegisters(bytes);
+	return sram.Hash(HashBytes(registers.data(), registers.size(), hash));
+}
+
+void Mapper004::SaveRegisters(StateWriter& bytes) const
+{
 	SaveBytes(bytes, regs, std::size(regs));
 	SaveBytes(bytes, bankSelect);
 	SaveBytes(bytes, mirrorMode);
@@ -50,8 +64,6 @@ Snapshot Mapper004::SaveState() const
 	SaveBytes(bytes, irqEnabled);
 	SaveBytes(bytes, irqState);
 	SaveBytes(bytes, reloadPending);
-
-	return bytes;
 }
 
 MirrorMode Mapper004::GetMirrorMode() const
@@ -99,7 +111,7 @@ bool Mapper004::MapCpuWrite(uint16_t& addr, uint8_t data)
 	bool evenAddr = addr % 2 == 0;
 	if (addr >= 0x6000 && addr < 0x8000)
 	{
-		sram[addr - 0x6000] = data;
+		sram.Write(addr - 0x6000, data);
 		return true;
 	}
 	else if (addr >= 0x8000 && addr < 0xA000)
@@ -187,7 +199,7 @@ bool Mapper004::MapPpuWrite(uint16_t& addr, uint8_t data)
 	if (MapPpuAddr(addr, newAddr))
 	{
 		if (newAddr < chr.size())
-			chr[newAddr] = data;
+			chr.Write(newAddr, data);
 		return true;
 	}
 	return false;
@@ -221,13 +233,18 @@ void Mapper004::CountScanline()
 	}
 }
 
-const std::vector<uint8_t>* Mapper004::GetSRam() const
+const PagedMemory* Mapper004::GetSRam() const
 {
 	return &sram;
 }
 
 void Mapper004::SetSRam(const std::vector<uint8_t>& data)
 {
-	sram = data;
-	sram.resize(0x2000);
+	sram.Fill(0);
+	sram.Write(0, data.data(), std::min(data.size(), sram.size()));
+}
+
+std::unique_ptr<Mapper> Mapper004::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper004>(prg, chr);
 }
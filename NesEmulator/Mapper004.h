@@ -4,24 +4,27 @@
 class Mapper004 : public Mapper
 {
 public:
-	Mapper004(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper004(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper004(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
 	bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapPpuWrite(uint16_t& addr, uint8_t data) override;
-	Snapshot SaveState() const override;
+	void LoadState(StateReader& bytes) override;
+	void SaveState(StateWriter& bytes) const override;
+	uint64_t HashState(uint64_t hash) const override;
 	MirrorMode GetMirrorMode() const override;
 	void Reset() override;
 	bool GetIrq() const override;
 	void ClearIrq() override;
 	void CountScanline() override;
-	const std::vector<uint8_t>* GetSRam() const override;
+	const PagedMemory* GetSRam() const override;
 	void SetSRam(const std::vector<uint8_t>& data) override;
+	std::unique_ptr<Mapper> Fork(RomView& prg, RomView& chr) const override;
 private:
+	void SaveRegisters(StateWriter& bytes) const;
 	bool MapPpuAddr(uint16_t& addr, uint32_t& newAddr) const;
 	int lastPrgBankNumber;
-	std::vector<uint8_t> sram;
+	PagedMemory sram;
 	uint8_t regs[8];
 	union
 	{
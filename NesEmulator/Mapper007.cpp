@@ -1,25 +1,24 @@
 #include "Mapper007.h"
 
-Mapper007::Mapper007(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper007::Mapper007(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr)
 {
 	Reset();
 }
 
-Mapper007::Mapper007(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr)
+void Mapper007::LoadState(StateReader& bytes)
 {
+	Mapper::LoadState(bytes);
 	LoadBytes(bytes, prgBank);
 	prgBank &= 0b1111;
 	LoadBytes(bytes, mirrorMode);
 }
 
-Snapshot Mapper007::SaveState() const
+void Mapper007::SaveState(StateWriter& bytes) const
 {
-	auto bytes = Mapper::SaveState();
+	Mapper::SaveState(bytes);
 	SaveBytes(bytes, prgBank);
 	SaveBytes(bytes, mirrorMode);
-	return bytes;
 }
 
 void Mapper007::Reset()
@@ -52,3 +51,8 @@ MirrorMode Mapper007::GetMirrorMode() const
 {
 	return mirrorMode;
 }
+
+std::unique_ptr<Mapper> Mapper007::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper007>(prg, chr);
+}
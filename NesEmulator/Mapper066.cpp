@@ -1,26 +1,25 @@
 #include "Mapper066.h"
 
-Mapper066::Mapper066(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper066::Mapper066(int mapperNumber, int prgChunks, int chrChunks, RomView& prg, RomView& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr)
 {
 	Reset();
 }
 
-Mapper066::Mapper066(Snapshot& bytes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(bytes, prg, chr)
+void Mapper066::LoadState(StateReader& bytes)
 {
+	Mapper::LoadState(bytes);
 	LoadBytes(bytes, prgBank);
 	prgBank &= 0b11;
 	LoadBytes(bytes, chrBank);
 	chrBank &= 0b11;
 }
 
-Snapshot Mapper066::SaveState() const
+void Mapper066::SaveState(StateWriter& bytes) const
 {
-	auto bytes = Mapper::SaveState();
+	Mapper::SaveState(bytes);
 	SaveBytes(bytes, prgBank);
 	SaveBytes(bytes, chrBank);
-	return bytes;
 }
 
 void Mapper066::Reset()
@@ -67,3 +66,8 @@ bool Mapper066::MapPpuWrite(uint16_t& addr, uint8_t data)
 {
 	return false;
 }
+
+std::unique_ptr<Mapper> Mapper066::Fork(RomView& prg, RomView& chr) const
+{
+	return ForkAs<Mapper066>(prg, chr);
+}
@@ -1,88 +1,257 @@
 #include "Nes.h"
 #include <Windows.h>
 #include "EmuFileException.h"
-#include "Audio.h"
+#include "Hash.h"
+#include <algorithm>
 
 Nes::Nes(const std::wstring& sramPath) :
 	controllers{ std::make_unique<Controller>(), std::make_unique<Controller>() },
-	ram{},
+	ram(0x800),
 	oam{},
 	sramPath(sramPath)
 {
 }
 
-void Nes::LoadState(const std::wstring& filename, std::vector<uint8_t>& bytes)
+template<typename F>
+size_t Nes::StateSize(F save) const
 {
-	std::vector<uint8_t> backup;
-	std::wstring backupFilename;
-	bool restore = (bool)cart;
-	if (restore)
+	stateScratch.clear();
+	StateWriter bytes(stateScratch);
+	save(bytes);
+	return stateScratch.size();
+}
+
+void Nes::LoadState(const std::wstring& filename, const Snapshot& snapshot)
+{
+	LoadState(filename, StateContainer(snapshot.data(), snapshot.size()));
+}
+
+void Nes::LoadState(const std::wstring& filename, const StateContainer& state)
+{
+	// Every section is checked against what its component reads before
+	// anything is loaded, so a bad file leaves the emulator untouched. A
+	// different rom needs new components to check against, which replace
+	// the old ones only once the checks have passed.
+	for (uint32_t tag : { SECTION_CPU, SECTION_CARTRIDGE, SECTION_MAPPER, SECTION_PPU, SECTION_APU, SECTION_RAM, SECTION_OAM, SECTION_NES })
+		if (state.SectionVersion(tag) != SECTION_VERSION)
+			throw EmuFileException("unsupported save state version");
+	StateReader cpuState = state.Read(SECTION_CPU);
+	StateReader cartState = state.Read(SECTION_CARTRIDGE);
+	StateReader mapperState = state.Read(SECTION_MAPPER);
+	StateReader ppuState = state.Read(SECTION_PPU);
+	StateReader apuState = state.Read(SECTION_APU);
+	StateReader ramState = state.Read(SECTION_RAM);
+	StateReader oamState = state.Read(SECTION_OAM);
+	StateReader nesState = state.Read(SECTION_NES);
+
+	const bool inPlace = cart && cart->CanLoadState(filename, cartState);
+	std::shared_ptr<Cartridge> oldCart;
+	std::unique_ptr<Cpu> oldCpu;
+	std::unique_ptr<Ppu> oldPpu;
+	std::shared_ptr<Apu> oldApu;
+	if (inPlace)
 	{
-		backup = SaveState();
-		backupFilename = cart->filename;
+		size_t mapperSize = StateSize([&](StateWriter& bytes) { cart->GetMapper().SaveState(bytes); });
+		cart->CheckState(cartState);
+		if (mapperState.Remaining() != mapperSize)
+			throw EmuFileException("invalid file");
 	}
-	try
+	else
 	{
-		size_t strLen;
-		LoadBytes(bytes, strLen);
-		if (strLen > 255)
-			throw EmuFileException("invalid file");
-
-		std::wstring str; // Unused
-		str.resize(strLen);
-		LoadBytes(bytes, str.data(), strLen);
-
+		// Building the cartridge checks its sections
 		auto GetFilenameFromPath = [](const std::wstring& path)
 		{
 			return path.substr(path.find_last_of(L"/\\") + 1);
 		};
-		cpu = std::make_unique<Cpu>(*this, bytes);
-		cart = std::make_shared<Cartridge>(sramPath + GetFilenameFromPath(filename) + L".sram", filename, bytes);
-		ppu = std::make_unique<Ppu>(*this, cart, bytes);
-		apu = std::make_shared<Apu>(*this, bytes);
-		SetEmulationSpeed(emulationSpeed);
-		LoadBytes(bytes, ram, std::size(ram));
-		LoadBytes(bytes, oam, std::size(oam));
-		LoadBytes(bytes, oamAddr);
-		LoadBytes(bytes, dmaAddr);
-		LoadBytes(bytes, dmaData);
-		LoadBytes(bytes, dmaReady);
-		LoadBytes(bytes, dmaMode);
-		LoadBytes(bytes, controllerLatch);
-		LoadBytes(bytes, clockNumber);
-		if (bytes.size() > 0)
-			throw EmuFileException("invalid file");
+		// Without an sram path, as for forks and benchmarks, nothing is saved
+		std::wstring cartSRamPath = sramPath.empty() ? L"" : sramPath + GetFilenameFromPath(filename) + L".sram";
+		auto newCart = std::make_shared<Cartridge>(cartSRamPath, filename, cartState, mapperState);
+		oldCart = std::move(cart);
+		oldCpu = std::move(cpu);
+		oldPpu = std::move(ppu);
+		oldApu = std::move(apu);
+		cart = newCart;
+		cpu = std::make_unique<Cpu>(*this);
+		ppu = std::make_unique<Ppu>(*this, cart);
+		apu = std::make_shared<Apu>(*this);
+	}
+
+	try
+	{
+		auto CheckSize = [](const StateReader& bytes, size_t expected)
+		{
+			if (bytes.Remaining() != expected)
+				throw EmuFileException("invalid file");
+		};
+		size_t cpuSize = StateSize([&](StateWriter& bytes) { cpu->SaveState(bytes); });
+		size_t ppuSize = StateSize([&](StateWriter& bytes) { ppu->SaveState(bytes); });
+		size_t apuSize = StateSize([&](StateWriter& bytes) { apu->SaveState(bytes); });
+		size_t oamSize = StateSize([&](StateWriter& bytes) { SaveOam(bytes); });
+		size_t registersSize = StateSize([&](StateWriter& bytes) { SaveRegisters(bytes); });
+		CheckSize(cpuState, cpuSize);
+		CheckSize(ppuState, ppuSize);
+		CheckSize(apuState, apuSize);
+		CheckSize(ramState, ram.size());
+		CheckSize(oamState, oamSize);
+		CheckSize(nesState, registersSize);
 	}
 	catch (EmuFileException&)
 	{
-		if (restore)
-			LoadState(backupFilename, backup);
+		if (!inPlace)
+		{
+			cart = std::move(oldCart);
+			cpu = std::move(oldCpu);
+			ppu = std::move(oldPpu);
+			apu = std::move(oldApu);
+		}
 		throw;
 	}
+
+	// Nothing below can fail
+	if (inPlace)
+	{
+		cart->LoadState(cartState, mapperState);
+	}
+	else
+	{
+		// The state's sram replaces the save's the next time it is recorded
+		cart->OpenSRam(false);
+		rewindBuffer.Clear();
+		SetEmulationSpeed(emulationSpeed);
+		ppu->Reposition(drawXOffset, drawYOffset);
+	}
+	cpu->LoadState(cpuState);
+	ppu->LoadState(ppuState);
+	apu->LoadState(apuState);
+	ram.LoadState(ramState);
+	LoadBytes(oamState, oam, std::size(oam));
+	LoadBytes(oamState, oamAddr);
+	LoadBytes(oamState, dmaAddr);
+	LoadBytes(oamState, dmaData);
+	LoadBytes(oamState, dmaReady);
+	LoadBytes(oamState, dmaMode);
+	LoadBytes(nesState, controllerLatch);
+	LoadBytes(nesState, clockNumber);
+	for (auto& controller : controllers)
+		controller->LoadState(nesState);
+}
+
+Snapshot Nes::SaveState() const
+{
+	Snapshot snapshot;
+	snapshot.reserve(stateSizeHint);
+	StateWriter bytes(snapshot);
+	SaveState(bytes);
+	stateSizeHint = snapshot.size();
+	return snapshot;
 }
 
-std::vector<uint8_t> Nes::SaveState() const
+void Nes::SaveState(StateWriter& bytes) const
 {
 	if (!cart)
 		throw EmuFileException("tried to save without a cartridge loaded");
-	std::vector<uint8_t> bytes;
-	SaveBytes(bytes, cart->filename.size());
-	SaveBytes(bytes, cart->filename.data(), cart->filename.size());
-
-	AppendVector(bytes, cpu->SaveState());
-	AppendVector(bytes, cart->SaveState());
-	AppendVector(bytes, ppu->SaveState());
-	AppendVector(bytes, apu->SaveState());
-	SaveBytes(bytes, ram, std::size(ram));
+
+	StateContainerWriter state(bytes, SECTION_COUNT);
+	cpu->SaveState(state.Begin(SECTION_CPU, SECTION_VERSION));
+	cart->SaveState(state.Begin(SECTION_CARTRIDGE, SECTION_VERSION));
+	cart->GetMapper().SaveState(state.Begin(SECTION_MAPPER, SECTION_VERSION));
+	ppu->SaveState(state.Begin(SECTION_PPU, SECTION_VERSION));
+	apu->SaveState(state.Begin(SECTION_APU, SECTION_VERSION));
+	ram.SaveState(state.Begin(SECTION_RAM, SECTION_VERSION));
+	SaveOam(state.Begin(SECTION_OAM, SECTION_VERSION));
+	SaveRegisters(state.Begin(SECTION_NES, SECTION_VERSION));
+	state.Finish();
+}
+
+void Nes::SaveOam(StateWriter& bytes) const
+{
 	SaveBytes(bytes, oam, std::size(oam));
 	SaveBytes(bytes, oamAddr);
 	SaveBytes(bytes, dmaAddr);
 	SaveBytes(bytes, dmaData);
 	SaveBytes(bytes, dmaReady);
 	SaveBytes(bytes, dmaMode);
+}
+
+void Nes::SaveRegisters(StateWriter& bytes) const
+{
 	SaveBytes(bytes, controllerLatch);
 	SaveBytes(bytes, clockNumber);
-	return bytes;
+	for (const auto& controller : controllers)
+		controller->SaveState(bytes);
+}
+
+uint64_t Nes::HashState() const
+{
+	if (!cart)
+		throw EmuFileException("tried to hash without a cartridge loaded");
+
+	// The cpu, ppu and registers are a few kilobytes and are hashed whole.
+	// Ram, chr ram and sram keep the hashes of pages that haven't changed.
+	stateScratch.clear();
+	StateWriter bytes(stateScratch);
+	cpu->SaveState(bytes);
+	ppu->SaveState(bytes);
+	SaveOam(bytes);
+	SaveRegisters(bytes);
+	uint64_t hash = HashBytes(stateScratch.data(), stateScratch.size());
+	hash = apu->HashState(hash);
+	hash = ram.Hash(hash);
+	return cart->HashState(hash);
+}
+
+std::unique_ptr<Nes> Nes::Fork() const
+{
+	if (!cart)
+		throw EmuFileException("tried to fork without a cartridge loaded");
+	auto forkedCart = cart->Fork();
+	if (!forkedCart)
+		throw EmuFileException("mapper " + std::to_string(cart->GetMapper().MapperNumber()) + " can't be forked");
+
+	// No sram path, so that nothing the fork loads can journal over the
+	// original's save
+	auto fork = std::make_unique<Nes>(L"");
+	fork->headless = true;
+	fork->rewindBudget = 0;
+	fork->cart = std::move(forkedCart);
+	fork->cpu = std::make_unique<Cpu>(*fork);
+	fork->ppu = std::make_unique<Ppu>(*fork, fork->cart);
+	fork->apu = std::make_shared<Apu>(*fork);
+	fork->SetEmulationSpeed(emulationSpeed);
+	fork->SetOutputEnabled(false, false);
+
+	// The chips only hold a few kilobytes, so they are copied through a
+	// state rather than shared
+	Snapshot scratch;
+	auto Copy = [&scratch](const auto& from, auto& to)
+	{
+		scratch.clear();
+		StateWriter writer(scratch);
+		from.SaveState(writer);
+		StateReader reader(scratch);
+		to.LoadState(reader);
+	};
+	Copy(*cpu, *fork->cpu);
+	Copy(*ppu, *fork->ppu);
+	Copy(*apu, *fork->apu);
+	for (size_t i = 0; i < std::size(controllers); i++)
+		Copy(*controllers[i], *fork->controllers[i]);
+
+	fork->ram = ram;
+	std::copy(std::begin(oam), std::end(oam), fork->oam);
+	fork->oamAddr = oamAddr;
+	fork->dmaAddr = dmaAddr;
+	fork->dmaData = dmaData;
+	fork->dmaReady = dmaReady;
+	fork->dmaMode = dmaMode;
+	fork->controllerLatch = controllerLatch;
+	fork->clockNumber = clockNumber;
+	return fork;
+}
+
+void Nes::SetInputSource(const uint8_t* buttons)
+{
+	inputSource = buttons;
 }
 
 Nes::~Nes()
@@ -122,21 +291,33 @@ void Nes::RunAsync()
 
 void Nes::DoIteration()
 {
+	auto start = Timer::Now();
 	if (cart)
 	{
-		if (running)
+		bool rewind = running && rewinding && rewindBuffer.Size() > 0;
+		apu->SetSynthesisEnabled(!mute && !headless && !rewind);
+		apu->SetStemRecorder(rewind ? nullptr : stemRecorder.get());
+		if (rewind)
+		{
+			StepBack();
+		}
+		else if (running)
 		{
 			if (emulationSpeed >= 0)
 			{
 				offDisplay = false;
 				ppu->ClearCurrentSpriteNumbers();
-				for (int i = 0; i < emulationSpeed; i++)
+				int ahead = std::clamp(runAhead.load(), 0, MAX_RUN_AHEAD);
+				if (ahead > 0 && emulationSpeed == 1)
 				{
-					do
-					{
-						Clock();
-					} while (!ppu->IsBeginningFrame());
+					RunAheadFrame(ahead);
 				}
+				else
+				{
+					for (int i = 0; i < emulationSpeed; i++)
+						ClockFrame();
+				}
+				CaptureRewind(emulationSpeed);
 			}
 			else
 			{
@@ -145,14 +326,14 @@ void Nes::DoIteration()
 					emuStep = -emulationSpeed;
 					offDisplay = false;
 					ppu->ClearCurrentSpriteNumbers();
-					do
-					{
-						Clock();
-					} while (!ppu->IsBeginningFrame());
+					ClockFrame();
+					CaptureRewind(1);
 				}
 				emuStep--;
 			}
 		}
+
+		JournalSRam();
 	}
 	else if (!offDisplay)
 	{
@@ -161,9 +342,95 @@ void Nes::DoIteration()
 				DrawPixel(x + drawXOffset, y + drawYOffset, Ppu::GetPowerOffScreen()[y * Ppu::DRAWABLE_WIDTH + x]);
 		offDisplay = true;
 	}
+
+	float elapsed = std::chrono::duration<float, std::milli>(Timer::Now() - start).count();
+	frameTimeMs = frameTimeMs + (elapsed - frameTimeMs) * 0.05f;
 	frameComplete = true;
 }
 
+void Nes::RunAheadFrame(int frames)
+{
+	// The real frame is heard but not seen. The frames after it are run
+	// silently from a saved state, the last one is drawn, and then the
+	// real state is put back.
+	ppu->SetVideoEnabled(false);
+	ClockFrame();
+
+	runAheadState.clear();
+	StateWriter bytes(runAheadState);
+	SaveState(bytes);
+
+	for (int i = 0; i < frames; i++)
+	{
+		SetOutputEnabled(i == frames - 1, false);
+		ClockFrame();
+	}
+
+	LoadState(cart->filename, runAheadState);
+	SetOutputEnabled(true, true);
+}
+
+void Nes::SetOutputEnabled(bool video, bool audio)
+{
+	ppu->SetVideoEnabled(video);
+	apu->SetSynthesisEnabled(audio && !mute && !headless);
+	apu->SetStemRecorder(audio ? stemRecorder.get() : nullptr);
+}
+
+bool Nes::IsJournalingSRam() const
+{
+	return cart && cart->HasSRamJournal();
+}
+
+bool Nes::GetSamples(float* outBlock)
+{
+	return apu && apu->GetSamples(outBlock);
+}
+
+float Nes::GetFrameTimeMs() const
+{
+	return frameTimeMs;
+}
+
+void Nes::CaptureRewind(int frames)
+{
+	rewindBuffer.SetBudget(rewindBudget);
+	if (rewindBudget == 0 || frames == 0)
+		return;
+
+	framesSinceCapture += frames;
+	if (framesSinceCapture < rewindInterval)
+		return;
+	framesSinceCapture = 0;
+
+	// Reuses the same buffer every time so capturing doesn't allocate
+	rewindState.clear();
+	StateWriter bytes(rewindState);
+	SaveState(bytes);
+	rewindBuffer.Push(rewindState);
+}
+
+void Nes::StepBack()
+{
+	if (!rewindBuffer.Pop(rewindState))
+		return;
+	try
+	{
+		LoadState(cart->filename, rewindState);
+	}
+	catch (EmuFileException&)
+	{
+		rewindBuffer.Clear();
+		return;
+	}
+
+	// Run the restored frame so that it is drawn
+	offDisplay = false;
+	ppu->ClearCurrentSpriteNumbers();
+	ClockFrame();
+	framesSinceCapture = 0;
+}
+
 int Nes::GetEmulationSpeed() const
 {
 	return emulationSpeed;
@@ -184,12 +451,7 @@ void Nes::SetEmulationSpeed(int speed)
 	}
 
 	if (apu)
-	{
-		if (speed < 0)
-			apu->SetEmulationSpeed(1.0f / (float)-speed);
-		else
-			apu->SetEmulationSpeed((float)speed);
-	}
+		apu->SetEmulationSpeed(emulationSpeed);
 }
 
 bool Nes::NotRunning() const
@@ -221,12 +483,14 @@ void Nes::RemoveCartridge()
 	ppu.reset();
 	apu.reset();
 	cart.reset();
+	rewindBuffer.Clear();
 }
 
 void Nes::InsertCartridge(std::shared_ptr<Cartridge> cart)
 {
 	std::unique_lock<std::mutex> lock(stateMtx);
 	this->cart = cart;
+	rewindBuffer.Clear();
 
 	cpu = std::make_unique<Cpu>(*this);
 	ppu = std::make_unique<Ppu>(*this, cart);
@@ -235,7 +499,14 @@ void Nes::InsertCartridge(std::shared_ptr<Cartridge> cart)
 
 	ppu->Reposition(drawXOffset, drawYOffset);
 	clockNumber = 0;
-	std::memset(ram, 0, std::size(ram));
+	ram.Fill(0);
+	std::fill(std::begin(oam), std::end(oam), ObjectAttributeMemory{});
+	oamAddr = 0;
+	dmaAddr = 0;
+	dmaData = 0;
+	dmaReady = false;
+	dmaMode = false;
+	controllerLatch = 0;
 
 	cart->Reset();
 	ppu->Reset();
@@ -288,7 +559,10 @@ void Nes::Clock()
 
 	if (controllerLatch & 1)
 		for (size_t i = 0; i < std::size(controllers); i++)
-			controllers[i]->SetState();
+			if (inputSource)
+				controllers[i]->SetState(inputSource[i]);
+			else
+				controllers[i]->SetState();
 }
 
 void Nes::ClockCpuInstruction()
@@ -303,6 +577,15 @@ void Nes::ClockCpuInstruction()
 	} while (cpu->InstructionComplete());
 }
 
+void Nes::JournalSRam()
+{
+	if (++framesSinceJournal >= SRAM_JOURNAL_INTERVAL)
+	{
+		framesSinceJournal = 0;
+		cart->JournalSRam();
+	}
+}
+
 void Nes::ClockFrame()
 {
 	do
@@ -319,11 +602,12 @@ void Nes::CpuWrite(uint16_t addr, uint8_t data)
 	else if (addr < 0x2000)
 	{
 		addr &= 0x7FF;
-		ram[addr] = data;
+		ram.Write(addr, data);
 	}
 	else if (addr >= 0x2000 && addr < 0x4000)
 	{
-		ppu->WriteFromCpu(addr, data);
+		if (ppu)
+			ppu->WriteFromCpu(addr, data);
 	}
 	else if ((addr >= 0x4000 && addr < 0x4014) || addr == 0x4015 || addr == 0x4017)
 	{
@@ -342,7 +626,7 @@ void Nes::CpuWrite(uint16_t addr, uint8_t data)
 
 uint8_t Nes::CpuRead(uint16_t addr, bool readonly)
 {
-	uint8_t data;
+	uint8_t data = 0;
 	if (cart->CpuRead(addr, data, readonly))
 	{
 	}
@@ -353,7 +637,8 @@ uint8_t Nes::CpuRead(uint16_t addr, bool readonly)
 	}
 	else if (addr >= 0x2000 && addr < 0x4000)
 	{
-		data = ppu->ReadFromCpu(addr, readonly);
+		if (ppu)
+			data = ppu->ReadFromCpu(addr, readonly);
 	}
 	else if (addr == 0x4015)
 	{
@@ -439,8 +724,30 @@ void Nes::WriteOAM(uint8_t data)
 	oamAddr++;
 }
 
-bool Nes::SaveSRam() const
+void Nes::StartStemRecording(const std::filesystem::path& path)
+{
+	auto recorder = std::make_unique<StemRecorder>(path, Apu::GetSampleRate());
+	std::unique_lock<std::mutex> lock(stateMtx);
+	stemRecorder = std::move(recorder);
+}
+
+void Nes::StopStemRecording()
+{
+	std::unique_lock<std::mutex> lock(stateMtx);
+	if (apu)
+		apu->SetStemRecorder(nullptr);
+	stemRecorder.reset();
+}
+
+bool Nes::IsRecordingStems() const
 {
+	return (bool)stemRecorder;
+}
+
+bool Nes::SaveSRam()
+{
+	// Taking the changed pages can't overlap the emulation writing them
+	std::unique_lock<std::mutex> lock(stateMtx);
 	if (!cart)
 		return true;
 	return cart->SaveSRam();
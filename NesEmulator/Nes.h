@@ -9,10 +9,16 @@
 #include <mutex>
 #include "Timer.h"
 #include "SaveStateUtil.h"
+#include "RewindBuffer.h"
+#include "StemRecorder.h"
+#include "PagedMemory.h"
+#include "StateContainer.h"
 
 class Nes
 {
 	friend class Emulator;
+	friend class NsfPlayer;
+	friend class NetplaySession;
 public:
 	Nes(const std::wstring& sramPath);
 	Nes(const Nes&) = delete;
@@ -36,9 +42,47 @@ public:
 	int GetEmulationSpeed() const;
 	void SetEmulationSpeed(int speed);
 	bool NotRunning() const;
-	std::vector<uint8_t> SaveState() const;
-	void LoadState(const std::wstring& filename, std::vector<uint8_t>& bytes);
-	bool SaveSRam() const;
+	Snapshot SaveState() const;
+	void SaveState(StateWriter& bytes) const;
+	void LoadState(const std::wstring& filename, const Snapshot& snapshot);
+	void LoadState(const std::wstring& filename, const StateContainer& state);
+	// Savestate sections, which can be read on their own through a
+	// StateContainer. Ram is saved as the 2 KiB of internal ram.
+	static constexpr uint32_t SECTION_CPU = StateTag("CPU ");
+	static constexpr uint32_t SECTION_CARTRIDGE = StateTag("CART");
+	static constexpr uint32_t SECTION_MAPPER = StateTag("MAPR");
+	static constexpr uint32_t SECTION_PPU = StateTag("PPU ");
+	static constexpr uint32_t SECTION_APU = StateTag("APU ");
+	static constexpr uint32_t SECTION_RAM = StateTag("RAM ");
+	static constexpr uint32_t SECTION_OAM = StateTag("OAM ");
+	static constexpr uint32_t SECTION_NES = StateTag("NES ");
+	static constexpr int SECTION_COUNT = 8;
+	static constexpr uint16_t SECTION_VERSION = 1;
+	// 64 bit hash of the emulated state, leaving out host settings such as
+	// the volumes. Meant to be called between frames, where two machines
+	// that have run the same game with the same input hash the same. Ram
+	// is hashed by page and only pages written since the last call are
+	// read again.
+	uint64_t HashState() const;
+	// Writes sram changes out and waits for them. They are also journaled
+	// in the background every SRAM_JOURNAL_INTERVAL iterations.
+	bool SaveSRam();
+	bool IsJournalingSRam() const;
+	void StartStemRecording(const std::filesystem::path& path);
+	void StopStemRecording();
+	bool IsRecordingStems() const;
+	// Headless copy of the running machine for searching ahead. Memory is
+	// shared page by page until either side writes, so forks are cheap to
+	// make and only cost what they change. Must be called between frames
+	// on the thread running this nes. The fork reads the keys until it is
+	// given its own input.
+	std::unique_ptr<Nes> Fork() const;
+	// Both ports latch these two bytes of buttons instead of reading the
+	// keys, or the keys again if null
+	void SetInputSource(const uint8_t* buttons);
+	// Pulls one block of audio for a sink, on the sink's thread. Returns
+	// false if nothing audible was produced.
+	bool GetSamples(float* outBlock);
 	int drawXOffset = 0;
 	int drawYOffset = 0;
 	std::atomic_bool offDisplay = false;
@@ -48,20 +92,57 @@ public:
 	std::atomic_bool masterBg = true;
 	std::atomic_bool masterFg = true;
 	std::atomic_bool mute = false;
+	std::atomic_bool headless = false;
+	std::atomic_bool filterAudio = false;
+	// Rewind history is captured every rewindInterval frames within
+	// rewindBudget bytes, and played back while rewinding is held
+	std::atomic_bool rewinding = false;
+	std::atomic_size_t rewindBudget = DEFAULT_REWIND_BUDGET;
+	std::atomic_int rewindInterval = DEFAULT_REWIND_INTERVAL;
+	static constexpr size_t DEFAULT_REWIND_BUDGET = 64 * 1024 * 1024;
+	static constexpr int DEFAULT_REWIND_INTERVAL = 2;
+	// Frames to run ahead of the real state to hide a game's input lag
+	std::atomic_int runAhead = 0;
+	static constexpr int MAX_RUN_AHEAD = 3;
+	static constexpr int SRAM_JOURNAL_INTERVAL = 60;
+	// Smoothed time spent emulating each host frame
+	float GetFrameTimeMs() const;
 
 	void Clock();
 	void ClockCpuInstruction();
 	void ClockFrame();
 private:
+	void SaveOam(StateWriter& bytes) const;
+	void SaveRegisters(StateWriter& bytes) const;
+	// Size of what save writes, for checking a section before loading it
+	template<typename F>
+	size_t StateSize(F save) const;
+	void SetOutputEnabled(bool video, bool audio);
+	void RunAheadFrame(int frames);
+	void CaptureRewind(int frames);
+	void StepBack();
+	// Journals the sram every SRAM_JOURNAL_INTERVAL calls. Called once per
+	// host frame by whatever is driving the nes.
+	void JournalSRam();
+
 	std::wstring sramPath;
 	int emuStep = 0;
+	RewindBuffer rewindBuffer{ DEFAULT_REWIND_BUDGET };
+	Snapshot rewindState;
+	int framesSinceCapture = 0;
+	int framesSinceJournal = 0;
+	Snapshot runAheadState;
+	std::atomic<float> frameTimeMs = 0.0f;
 	int clockNumber = 0;
 	std::shared_ptr<Cartridge> cart;
 	std::unique_ptr<Cpu> cpu;
 	std::unique_ptr<Ppu> ppu;
 	std::shared_ptr<Apu> apu;
-	uint8_t ram[0x800];
+	std::unique_ptr<StemRecorder> stemRecorder;
+	PagedMemory ram;
 	std::unique_ptr<Controller> controllers[2];
+	// When set, both ports latch these buttons instead of reading the keys
+	const uint8_t* inputSource = nullptr;
 	uint8_t controllerLatch = 0;
 
 	// Sprites
@@ -78,5 +159,9 @@ private:
 	std::mutex stateMtx;
 	std::thread thrd;
 	std::atomic_int emulationSpeed = 1;
+	// Size of the last savestate, reserved up front for the next one
+	mutable std::atomic_size_t stateSizeHint = 0;
+	// Reused by HashState and LoadState's size checks
+	mutable Snapshot stateScratch;
 	void RunAsync();
 };
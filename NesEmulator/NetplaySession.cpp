@@ -0,0 +1,233 @@
+#include "NetplaySession.h"
+#include <algorithm>
+#include <cstddef>
+
+NetplaySession::NetplaySession(Nes& nes, int player, uint16_t localPort, const std::string& remoteHost, uint16_t remotePort, int frameDelay) :
+	nes(nes),
+	socket(localPort, remoteHost, remotePort),
+	player(player & 1),
+	frameDelay(std::clamp(frameDelay, 0, MAX_FRAME_DELAY)),
+	localInputEnd(this->frameDelay),
+	remoteInputEnd(this->frameDelay)
+{
+	// Both sides power on from the same rom and sram so that they agree
+	// from the first frame. Nothing is pressed during the first frameDelay
+	// frames as input for them can't have been sent yet.
+	auto GetFilenameFromPath = [](const std::wstring& path)
+	{
+		return path.substr(path.find_last_of(L"/\\") + 1);
+	};
+	std::wstring filename = nes.cart->filename;
+	nes.SaveSRam();
+	nes.InsertCartridge(std::make_shared<Cartridge>(nes.sramPath + GetFilenameFromPath(filename) + L".sram", filename));
+	nes.inputSource = buttons;
+}
+
+NetplaySession::~NetplaySession()
+{
+	nes.inputSource = nullptr;
+	nes.SetOutputEnabled(true, true);
+}
+
+bool NetplaySession::Update(uint8_t localButtons)
+{
+	ReceivePackets();
+
+	// Wait when the guesses would go back further than can be rolled
+	// back, and now and then when this side is running ahead of the peer.
+	// Advantages are both measured against stale frame numbers, so the
+	// latency cancels out of their difference.
+	int advantage = frame - peerFrame;
+	waiting = !nes.running
+		|| frame - remoteInputEnd >= MAX_ROLLBACK
+		|| localInputEnd - peerAck >= INPUT_HISTORY
+		|| (frame % SYNC_INTERVAL == 0 && advantage - peerAdvantage >= 2);
+	if (waiting)
+	{
+		SendInput();
+		nes.frameComplete = true;
+		return false;
+	}
+
+	InputAt(player, localInputEnd++) = localButtons;
+	SendInput();
+
+	if (rollbackFrame < frame)
+		Rollback();
+	RunFrame(true);
+	CheckHashes();
+	nes.frameComplete = true;
+	return true;
+}
+
+void NetplaySession::ReceivePackets()
+{
+	Packet packet{};
+	size_t size;
+	const int remote = player ^ 1;
+	while ((size = socket.Receive(&packet, sizeof(packet))) != 0)
+	{
+		if (size < offsetof(Packet, inputs)
+			|| packet.magic != MAGIC
+			|| packet.frameDelay != frameDelay
+			|| packet.inputCount > MAX_PACKET_INPUTS
+			|| size < offsetof(Packet, inputs) + packet.inputCount)
+			continue;
+
+		peerAck = std::max(peerAck, (int)packet.ack);
+		if (packet.frame >= peerFrame)
+		{
+			peerFrame = packet.frame;
+			peerAdvantage = packet.advantage;
+		}
+
+		// Input is only taken in order, anything after a gap is resent
+		for (int i = 0; i < packet.inputCount; i++)
+		{
+			int inputFrame = packet.inputStart + i;
+			if (inputFrame < remoteInputEnd)
+				continue;
+			if (inputFrame > remoteInputEnd)
+				break;
+			uint8_t input = packet.inputs[i];
+			InputAt(remote, inputFrame) = input;
+			if (inputFrame < frame && guesses[inputFrame % INPUT_HISTORY] != input)
+				rollbackFrame = std::min(rollbackFrame, inputFrame);
+			remoteInputEnd++;
+		}
+
+		if (packet.hashFrame >= 0)
+		{
+			remoteHashes[(packet.hashFrame / HASH_INTERVAL) % HASH_HISTORY] = { packet.hashFrame, packet.hash };
+			CompareHashes(packet.hashFrame);
+		}
+	}
+}
+
+void NetplaySession::SendInput()
+{
+	// Everything the peer hasn't acknowledged is sent every time, so a
+	// lost packet is made up for by the next one
+	Packet packet{};
+	packet.magic = MAGIC;
+	packet.frame = frame;
+	packet.advantage = frame - peerFrame;
+	packet.ack = remoteInputEnd;
+	packet.inputStart = std::clamp(peerAck, localInputEnd - MAX_PACKET_INPUTS, localInputEnd);
+	packet.inputCount = (uint8_t)(localInputEnd - packet.inputStart);
+	for (int i = 0; i < packet.inputCount; i++)
+		packet.inputs[i] = InputAt(player, packet.inputStart + i);
+
+	const HashEntry& latest = localHashes[((nextHashFrame / HASH_INTERVAL) + HASH_HISTORY - 1) % HASH_HISTORY];
+	packet.hashFrame = latest.frame;
+	packet.hash = latest.hash;
+	packet.frameDelay = (uint8_t)frameDelay;
+
+	socket.Send(&packet, offsetof(Packet, inputs) + packet.inputCount);
+}
+
+void NetplaySession::Rollback()
+{
+	// Replaying can't go back further than the saved states, which the
+	// wait in Update makes sure of
+	int present = frame;
+	frame = rollbackFrame;
+	rollbackFrame = INT_MAX;
+	nes.LoadState(nes.cart->filename, states[frame % STATE_HISTORY]);
+	while (frame < present)
+	{
+		RunFrame(false);
+		rollbackFrames++;
+	}
+}
+
+void NetplaySession::RunFrame(bool present)
+{
+	Snapshot& state = states[frame % STATE_HISTORY];
+	state.clear();
+	StateWriter bytes(state);
+	nes.SaveState(bytes);
+	if (frame % HASH_INTERVAL == 0)
+		stateHashes[frame % STATE_HISTORY] = nes.HashState();
+
+	// Past the received input the remote player is guessed to still be
+	// holding what they last sent
+	const int remote = player ^ 1;
+	uint8_t guess = frame < remoteInputEnd ? InputAt(remote, frame) : InputAt(remote, remoteInputEnd - 1);
+	if (remoteInputEnd == 0)
+		guess = 0;
+	guesses[frame % INPUT_HISTORY] = guess;
+	buttons[player] = InputAt(player, frame);
+	buttons[remote] = guess;
+
+	if (present)
+	{
+		nes.offDisplay = false;
+		nes.ppu->ClearCurrentSpriteNumbers();
+	}
+	nes.SetOutputEnabled(present, present);
+	nes.ClockFrame();
+	frame++;
+	// Frames run again after a rollback are not new host frames
+	if (present)
+		nes.JournalSRam();
+}
+
+void NetplaySession::CheckHashes()
+{
+	// A state is final once all input before it has been received. The
+	// states since then are still in the history because of the wait in
+	// Update.
+	while (nextHashFrame < frame && nextHashFrame <= remoteInputEnd)
+	{
+		if (frame - nextHashFrame <= STATE_HISTORY)
+		{
+			localHashes[(nextHashFrame / HASH_INTERVAL) % HASH_HISTORY] = { nextHashFrame, stateHashes[nextHashFrame % STATE_HISTORY] };
+			CompareHashes(nextHashFrame);
+		}
+		nextHashFrame += HASH_INTERVAL;
+	}
+}
+
+void NetplaySession::CompareHashes(int hashFrame)
+{
+	const HashEntry& local = localHashes[(hashFrame / HASH_INTERVAL) % HASH_HISTORY];
+	const HashEntry& remote = remoteHashes[(hashFrame / HASH_INTERVAL) % HASH_HISTORY];
+	if (local.frame == hashFrame && remote.frame == hashFrame && local.hash != remote.hash && desyncFrame < 0)
+		desyncFrame = hashFrame;
+}
+
+uint8_t& NetplaySession::InputAt(int port, int frame)
+{
+	return inputs[port][frame % INPUT_HISTORY];
+}
+
+int NetplaySession::GetPlayer() const
+{
+	return player;
+}
+
+int NetplaySession::GetFrame() const
+{
+	return frame;
+}
+
+int NetplaySession::GetRollbackFrames() const
+{
+	return rollbackFrames;
+}
+
+bool NetplaySession::IsWaiting() const
+{
+	return waiting;
+}
+
+bool NetplaySession::IsDesynced() const
+{
+	return desyncFrame >= 0;
+}
+
+int NetplaySession::GetDesyncFrame() const
+{
+	return desyncFrame;
+}
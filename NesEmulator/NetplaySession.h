@@ -0,0 +1,101 @@
+#pragma once
+#include <climits>
+#include <cstdint>
+#include <string>
+#include "Nes.h"
+#include "UdpSocket.h"
+
+// Two player rollback netplay over UDP. Each side sends its own input a
+// few frames before it's needed and assumes the other player is still
+// holding whatever they last sent. When the real input turns out to be
+// different, the machine goes back to the state saved before that frame
+// and quietly replays up to the present. Both sides swap hashes of
+// confirmed states every so often so that a desync gets noticed.
+//
+// Both sides must run the same rom with the same sram and frame delay.
+class NetplaySession
+{
+public:
+	// Resets the nes and takes over both of its controller ports
+	NetplaySession(Nes& nes, int player, uint16_t localPort, const std::string& remoteHost, uint16_t remotePort, int frameDelay = DEFAULT_FRAME_DELAY);
+	NetplaySession(const NetplaySession&) = delete;
+	NetplaySession& operator=(const NetplaySession&) = delete;
+	~NetplaySession();
+	// Called once per host frame in place of Nes::DoIteration. Returns
+	// false if no frame was run while waiting for the peer.
+	bool Update(uint8_t localButtons);
+	int GetPlayer() const;
+	int GetFrame() const;
+	int GetRollbackFrames() const;
+	bool IsWaiting() const;
+	bool IsDesynced() const;
+	int GetDesyncFrame() const;
+	static constexpr int DEFAULT_FRAME_DELAY = 2;
+	static constexpr int MAX_FRAME_DELAY = 8;
+	static constexpr int MAX_ROLLBACK = 8;
+	static constexpr int HASH_INTERVAL = 60;
+private:
+	static constexpr uint32_t MAGIC = 0x504E4E45;
+	static constexpr int INPUT_HISTORY = 128;
+	static constexpr int STATE_HISTORY = MAX_ROLLBACK + 2;
+	static constexpr int HASH_HISTORY = 8;
+	static constexpr int MAX_PACKET_INPUTS = 64;
+	// Frames between checks of whether this side is running ahead
+	static constexpr int SYNC_INTERVAL = 10;
+
+	struct Packet
+	{
+		uint32_t magic;
+		int32_t frame;
+		// How far the sender is ahead of the last frame it heard from us
+		int32_t advantage;
+		// The sender has all of our input before this frame
+		int32_t ack;
+		int32_t inputStart;
+		int32_t hashFrame;
+		uint64_t hash;
+		uint8_t frameDelay;
+		uint8_t inputCount;
+		uint8_t inputs[MAX_PACKET_INPUTS];
+	};
+	struct HashEntry
+	{
+		int frame = -1;
+		uint64_t hash = 0;
+	};
+
+	void ReceivePackets();
+	void SendInput();
+	void Rollback();
+	void RunFrame(bool present);
+	void CheckHashes();
+	void CompareHashes(int hashFrame);
+	uint8_t& InputAt(int port, int frame);
+
+	Nes& nes;
+	UdpSocket socket;
+	int player;
+	int frameDelay;
+	// The next frame to run, and the ends of the input received so far
+	int frame = 0;
+	int localInputEnd;
+	int remoteInputEnd;
+	int peerAck = 0;
+	int peerFrame = 0;
+	int peerAdvantage = 0;
+	// Earliest frame that was run on a wrong guess of the remote input
+	int rollbackFrame = INT_MAX;
+	int rollbackFrames = 0;
+	bool waiting = false;
+	int desyncFrame = -1;
+	int nextHashFrame = HASH_INTERVAL;
+
+	uint8_t inputs[2][INPUT_HISTORY]{};
+	uint8_t guesses[INPUT_HISTORY]{};
+	uint8_t buttons[2]{};
+	Snapshot states[STATE_HISTORY];
+	// Hashes of the states on hash frames
+	uint64_t stateHashes[STATE_HISTORY]{};
+	HashEntry localHashes[HASH_HISTORY];
+	HashEntry remoteHashes[HASH_HISTORY];
+};
@@ -0,0 +1,21 @@
+#include "NullSink.h"
+
+NullSink::NullSink(SynthFunc synth, FilterFunc filter, int sampleRate) :
+	PacedSink(synth, filter, sampleRate)
+{
+	Start();
+}
+
+NullSink::~NullSink()
+{
+	Stop();
+}
+
+int NullSink::GetLatencyMs() const
+{
+	return 0;
+}
+
+void NullSink::ConsumeBlock(const Sample* block)
+{
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "PacedSink.h"
+
+// Pulls and discards audio at the normal rate. Useful for running without
+// a sound device while still paying the full cost of producing audio.
+class NullSink : public PacedSink
+{
+public:
+	NullSink(SynthFunc synth, FilterFunc filter = nullptr, int sampleRate = DEFAULT_SAMPLE_RATE);
+	~NullSink() override;
+	int GetLatencyMs() const override;
+private:
+	void ConsumeBlock(const Sample* block) override;
+};
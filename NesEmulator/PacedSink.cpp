@@ -0,0 +1,47 @@
+#include "PacedSink.h"
+#include <chrono>
+
+PacedSink::PacedSink(SynthFunc synth, FilterFunc filter, int sampleRate) :
+	AudioSink(synth, filter, sampleRate),
+	block(SAMPLES_PER_BLOCK)
+{
+}
+
+PacedSink::~PacedSink()
+{
+	Stop();
+}
+
+void PacedSink::Start()
+{
+	thrdActive = true;
+	thrd = std::thread(&PacedSink::Run, this);
+}
+
+void PacedSink::Stop()
+{
+	thrdActive = false;
+	if (thrd.joinable())
+		thrd.join();
+}
+
+void PacedSink::Run()
+{
+	using namespace std::chrono;
+	const auto period = duration_cast<steady_clock::duration>(
+		duration<double>((double)SAMPLES_PER_BLOCK / GetSampleRate()));
+
+	auto next = steady_clock::now();
+	while (thrdActive)
+	{
+		RenderBlock(block.data());
+		ConsumeBlock(block.data());
+
+		// Don't try to catch up after a long stall
+		next += period;
+		auto now = steady_clock::now();
+		if (now - next > period * 4)
+			next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "AudioSink.h"
+
+// Base for sinks without a device clock. A worker thread pulls blocks at
+// the sample rate, as a sound card would, and hands them to ConsumeBlock.
+// Derived classes call Start at the end of their constructor and Stop at
+// the start of their destructor.
+class PacedSink : public AudioSink
+{
+public:
+	PacedSink(SynthFunc synth, FilterFunc filter, int sampleRate);
+	~PacedSink() override;
+protected:
+	void Start();
+	void Stop();
+	virtual void ConsumeBlock(const Sample* block) = 0;
+private:
+	void Run();
+	std::thread thrd;
+	std::atomic_bool thrdActive = false;
+	std::vector<Sample> block;
+};
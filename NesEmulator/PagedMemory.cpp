@@ -0,0 +1,181 @@
+#include "PagedMemory.h"
+#include <algorithm>
+#include <cstring>
+#include "Hash.h"
+
+PagedMemory::PagedMemory(size_t size) :
+	length(size)
+{
+	size_t count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	storage.reserve(count);
+	pages.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		storage.push_back(std::make_shared<Page>());
+		pages.push_back(storage.back()->bytes);
+	}
+	writable.assign(count, true);
+	dirty.assign(count, true);
+	hashed.assign(count, false);
+	pageHashes.assign(count, 0);
+	Fill(0);
+}
+
+PagedMemory::PagedMemory(const uint8_t* data, size_t size) :
+	PagedMemory(size)
+{
+	Write(0, data, size);
+}
+
+PagedMemory::PagedMemory(const PagedMemory& other) :
+	storage(other.storage),
+	pages(other.pages),
+	writable(other.writable.size(), false),
+	dirty(other.dirty.size(), true),
+	hashed(other.hashed),
+	pageHashes(other.pageHashes),
+	length(other.length)
+{
+	std::fill(other.writable.begin(), other.writable.end(), false);
+}
+
+PagedMemory& PagedMemory::operator=(const PagedMemory& other)
+{
+	if (this != &other)
+	{
+		storage = other.storage;
+		pages = other.pages;
+		writable.assign(other.writable.size(), false);
+		dirty.assign(other.dirty.size(), true);
+		hashed = other.hashed;
+		pageHashes = other.pageHashes;
+		length = other.length;
+		std::fill(other.writable.begin(), other.writable.end(), false);
+	}
+	return *this;
+}
+
+size_t PagedMemory::size() const
+{
+	return length;
+}
+
+void PagedMemory::Fill(uint8_t value)
+{
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		if (!writable[i])
+			BeginWrite(i, false);
+		dirty[i] = true;
+		std::memset(pages[i], value, PAGE_SIZE);
+	}
+}
+
+void PagedMemory::Read(size_t offset, uint8_t* out, size_t count) const
+{
+	while (count > 0)
+	{
+		size_t inPage = offset % PAGE_SIZE;
+		size_t n = std::min(count, PAGE_SIZE - inPage);
+		std::memcpy(out, pages[offset / PAGE_SIZE] + inPage, n);
+		out += n;
+		offset += n;
+		count -= n;
+	}
+}
+
+void PagedMemory::Write(size_t offset, const uint8_t* data, size_t count)
+{
+	while (count > 0)
+	{
+		size_t page = offset / PAGE_SIZE;
+		size_t inPage = offset % PAGE_SIZE;
+		size_t n = std::min(count, PAGE_SIZE - inPage);
+		// A page that is overwritten in full doesn't need its old contents
+		if (!writable[page])
+			BeginWrite(page, n != PAGE_SIZE);
+		dirty[page] = true;
+		std::memcpy(pages[page] + inPage, data, n);
+		data += n;
+		offset += n;
+		count -= n;
+	}
+}
+
+void PagedMemory::SaveState(StateWriter& bytes) const
+{
+	for (size_t offset = 0; offset < length; offset += PAGE_SIZE)
+		SaveBytes(bytes, pages[offset / PAGE_SIZE], std::min(PAGE_SIZE, length - offset));
+}
+
+void PagedMemory::LoadState(StateReader& bytes)
+{
+	// Pages that load unchanged stay shared, hashed and clean, which is
+	// most of them when rolling back a few frames
+	uint8_t loaded[PAGE_SIZE];
+	for (size_t offset = 0; offset < length; offset += PAGE_SIZE)
+	{
+		size_t page = offset / PAGE_SIZE;
+		size_t n = std::min(PAGE_SIZE, length - offset);
+		LoadBytes(bytes, loaded, n);
+		if (std::memcmp(pages[page], loaded, n) == 0)
+			continue;
+		if (!writable[page])
+			BeginWrite(page, n != PAGE_SIZE);
+		dirty[page] = true;
+		std::memcpy(pages[page], loaded, n);
+	}
+}
+
+uint64_t PagedMemory::Hash(uint64_t seed) const
+{
+	// Hashed pages have to go through BeginWrite again before they change
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		if (!hashed[i])
+		{
+			pageHashes[i] = HashBytes(pages[i], std::min(PAGE_SIZE, length - i * PAGE_SIZE));
+			hashed[i] = true;
+			writable[i] = false;
+		}
+	}
+	return HashBytes(pageHashes.data(), pageHashes.size() * sizeof(uint64_t), seed);
+}
+
+void PagedMemory::TakeDirtyPages(std::vector<size_t>& out) const
+{
+	// Every page goes back through BeginWrite, which marks it dirty again
+	// on its next single byte write
+	out.clear();
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		if (dirty[i])
+			out.push_back(i);
+		dirty[i] = false;
+		writable[i] = false;
+	}
+}
+
+size_t PagedMemory::UniquePages() const
+{
+	return (size_t)std::count_if(storage.begin(), storage.end(), [](const auto& page)
+	{
+		return page.use_count() == 1;
+	});
+}
+
+void PagedMemory::BeginWrite(size_t page, bool keepContents)
+{
+	// Once the other copies are gone the page can be taken over as it is
+	if (storage[page].use_count() > 1)
+	{
+		auto copy = std::make_shared<Page>();
+		if (keepContents)
+			std::memcpy(copy->bytes, pages[page], PAGE_SIZE);
+		storage[page] = std::move(copy);
+		pages[page] = storage[page]->bytes;
+	}
+	writable[page] = true;
+	dirty[page] = true;
+	hashed[page] = false;
+}
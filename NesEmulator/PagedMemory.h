@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "SaveStateUtil.h"
+
+// Memory split into pages that copies share until one of them writes, so
+// copying a block only copies page pointers. The first write to a shared
+// page gives the writer its own copy of just that page. Each page's hash
+// is kept until the page is written to, so hashing only reads what has
+// changed since the last time, and pages written since they were last
+// taken are tracked the same way for saving to disk.
+class PagedMemory
+{
+public:
+	static constexpr size_t PAGE_SIZE = 0x400;
+
+	PagedMemory() = default;
+	// Zero filled, the size is rounded up to whole pages
+	explicit PagedMemory(size_t size);
+	PagedMemory(const uint8_t* data, size_t size);
+	PagedMemory(const PagedMemory& other);
+	PagedMemory& operator=(const PagedMemory& other);
+	PagedMemory(PagedMemory&&) = default;
+	PagedMemory& operator=(PagedMemory&&) = default;
+
+	uint8_t operator[](size_t index) const
+	{
+		return pages[index / PAGE_SIZE][index % PAGE_SIZE];
+	}
+	void Write(size_t index, uint8_t value)
+	{
+		size_t page = index / PAGE_SIZE;
+		if (!writable[page])
+			BeginWrite(page, true);
+		pages[page][index % PAGE_SIZE] = value;
+	}
+	size_t size() const;
+	void Fill(uint8_t value);
+	void Read(size_t offset, uint8_t* out, size_t count) const;
+	void Write(size_t offset, const uint8_t* data, size_t count);
+	// Saved as the plain bytes, so the layout is the same as an array's
+	void SaveState(StateWriter& bytes) const;
+	void LoadState(StateReader& bytes);
+	uint64_t Hash(uint64_t seed = 0) const;
+	// Gives the pages written since the last call, in order. A new or
+	// copied block starts with every page written.
+	void TakeDirtyPages(std::vector<size_t>& out) const;
+	// Pages that no other copy shares, for measuring memory use
+	size_t UniquePages() const;
+private:
+	struct Page
+	{
+		uint8_t bytes[PAGE_SIZE];
+	};
+	// Unshares the page, drops its hash and marks it dirty
+	void BeginWrite(size_t page, bool keepContents);
+	std::vector<std::shared_ptr<Page>> storage;
+	// Raw pointers into storage so that reads skip the shared_ptr
+	std::vector<uint8_t*> pages;
+	// Whether each page can be written without any bookkeeping. Copying a
+	// block, hashing it or taking its dirty pages clears these, hence
+	// mutable.
+	mutable std::vector<uint8_t> writable;
+	mutable std::vector<uint8_t> dirty;
+	mutable std::vector<uint8_t> hashed;
+	mutable std::vector<uint64_t> pageHashes;
+	size_t length = 0;
+};
@@ -19,12 +19,7 @@ Ppu::Ppu(Nes& nes, std::shared_ptr<Cartridge> cart) :
 	tramAddr.reg = 0;
 }
 
-Ppu::Ppu(Nes& nes, std::shared_ptr<Cartridge> cart, Snapshot& bytes) :
-	nes(nes),
-	cart(cart),
-	drawXOffset(0),
-	drawYOffset(0),
-	currentSpriteNumbers{}
+void Ppu::LoadState(StateReader& bytes)
 {
 	LoadBytes(bytes, (uint8_t*)nameTables, std::size(nameTables) * std::size(nameTables[0]));
 	LoadBytes(bytes, (uint8_t*)palettes, std::size(palettes) * std::size(palettes[0]));
@@ -66,9 +61,8 @@ Ppu::Ppu(Nes& nes, std::shared_ptr<Cartridge> cart, Snapshot& bytes) :
 	LoadBytes(bytes, sprite0Loaded);
 }
 
-Snapshot Ppu::SaveState() const
+void Ppu::SaveState(StateWriter& bytes) const
 {
-	std::vector<uint8_t> bytes;
 	SaveBytes(bytes, (uint8_t*)nameTables, std::size(nameTables) * std::size(nameTables[0]));
 	SaveBytes(bytes, (uint8_t*)palettes, std::size(palettes) * std::size(palettes[0]));
 
@@ -107,7 +101,6 @@ Snapshot Ppu::SaveState() const
 	SaveBytes(bytes, spritePatternShifterHi);
 	SaveBytes(bytes, spriteCount);
 	SaveBytes(bytes, sprite0Loaded);
-	return bytes;
 }
 
 bool Ppu::IsBeginningFrame() const
@@ -682,14 +675,20 @@ void Ppu::OutputColour()
 	if (isDrawing)
 	{
 		colourOutput = PpuRead(0x3F00 + paletteNumber * 4 + paletteIndex);
-		DrawPixel(
-			drawXOffset + dot - 1,
-			drawYOffset + scanline,
-			colourOutput
-		);
+		if (videoEnabled)
+			DrawPixel(
+				drawXOffset + dot - 1,
+				drawYOffset + scanline,
+				colourOutput
+			);
 	}
 }
 
+void Ppu::SetVideoEnabled(bool enabled)
+{
+	videoEnabled = enabled;
+}
+
 void Ppu::Reposition(int x, int y)
 {
 	drawXOffset = x;
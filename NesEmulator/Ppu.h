@@ -33,7 +33,6 @@ class Ppu
 	friend class Emulator;
 public:
 	Ppu(Nes& nes, std::shared_ptr<Cartridge> cart);
-	Ppu(Nes& nes, std::shared_ptr<Cartridge> cart, Snapshot& bytes);
 	void Reset();
 	void Clock();
 	void WriteFromCpu(uint16_t addr, uint8_t data);
@@ -41,8 +40,11 @@ public:
 	bool CheckNmi();
 	bool IsBeginningFrame() const;
 	void Reposition(int x, int y);
-	Snapshot SaveState() const;
+	void LoadState(StateReader& bytes);
+	void SaveState(StateWriter& bytes) const;
 	void ClearCurrentSpriteNumbers();
+	// Frames are still emulated in full when off, only drawing is skipped
+	void SetVideoEnabled(bool enabled);
 	static constexpr int DRAWABLE_WIDTH = 256;
 	static constexpr int DRAWABLE_HEIGHT = 240;
 	static constexpr int DOT_COUNT = 341;
@@ -51,6 +53,7 @@ public:
 private:
 	std::atomic_int drawXOffset;
 	std::atomic_int drawYOffset;
+	bool videoEnabled = true;
 
 	// Private bus
 	void PpuWrite(uint16_t addr, uint8_t data);
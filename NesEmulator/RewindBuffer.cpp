@@ -0,0 +1,221 @@
+#include "RewindBuffer.h"
+#include <cstring>
+
+static void WriteVarint(std::vector<uint8_t>& out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+static size_t ReadVarint(const uint8_t*& p)
+{
+	size_t value = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		uint8_t b = *p++;
+		value |= (size_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return value;
+	}
+}
+
+static uint64_t ReadWord(const uint8_t* p, size_t word)
+{
+	uint64_t v;
+	std::memcpy(&v, p + word * 8, sizeof(v));
+	return v;
+}
+
+RewindBuffer::RewindBuffer(size_t budget, int keyframeInterval) :
+	budget(budget),
+	keyframeInterval(keyframeInterval)
+{
+}
+
+void RewindBuffer::Push(const Snapshot& state)
+{
+	bool keyframe = entries.empty()
+		|| newest.size() != state.size()
+		|| sinceKeyframe >= keyframeInterval;
+
+	Encode(keyframe ? nullptr : newest.data(), state.data(), state.size(), scratch);
+	std::vector<uint8_t> data = TakeStorage(scratch.size());
+	data.assign(scratch.begin(), scratch.end());
+	entries.push_back({ std::move(data), state.size(), keyframe });
+	used += entries.back().data.capacity();
+	sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+
+	newest.assign(state.begin(), state.end());
+	Evict();
+}
+
+bool RewindBuffer::Pop(Snapshot& state)
+{
+	if (entries.empty())
+		return false;
+	state.assign(newest.begin(), newest.end());
+
+	Entry entry = std::move(entries.back());
+	entries.pop_back();
+	used -= entry.data.capacity();
+	if (entries.empty())
+	{
+		newest.clear();
+		sinceKeyframe = 0;
+		Recycle(std::move(entry.data));
+		return true;
+	}
+
+	if (!entry.keyframe)
+	{
+		// Xor is its own inverse, so the delta also steps backwards
+		Apply(entry, newest.data());
+		sinceKeyframe--;
+		Recycle(std::move(entry.data));
+		return true;
+	}
+	Recycle(std::move(entry.data));
+
+	// Stepping back over a keyframe replays the group before it
+	size_t first = entries.size() - 1;
+	while (!entries[first].keyframe)
+		first--;
+	newest.assign(entries[first].stateSize, 0);
+	for (size_t i = first; i < entries.size(); i++)
+		Apply(entries[i], newest.data());
+	sinceKeyframe = (int)(entries.size() - first);
+	return true;
+}
+
+void RewindBuffer::Clear()
+{
+	entries.clear();
+	newest.clear();
+	spare.clear();
+	used = 0;
+	sinceKeyframe = 0;
+}
+
+void RewindBuffer::SetBudget(size_t budget)
+{
+	this->budget = budget;
+	Evict();
+}
+
+size_t RewindBuffer::Size() const
+{
+	return entries.size();
+}
+
+size_t RewindBuffer::GetMemoryUsed() const
+{
+	return used;
+}
+
+void RewindBuffer::Evict()
+{
+	// Drop whole keyframe groups from the front, but never the newest one
+	while (used > budget)
+	{
+		size_t end = 1;
+		while (end < entries.size() && !entries[end].keyframe)
+			end++;
+		if (end == entries.size())
+			break;
+		for (size_t i = 0; i < end; i++)
+		{
+			used -= entries[i].data.capacity();
+			Recycle(std::move(entries[i].data));
+		}
+		entries.erase(entries.begin(), entries.begin() + end);
+	}
+}
+
+void RewindBuffer::Recycle(std::vector<uint8_t>&& data)
+{
+	// A keyframe group's worth is enough to cover an eviction
+	if (spare.size() >= (size_t)keyframeInterval)
+		spare.erase(spare.begin());
+	spare.push_back(std::move(data));
+}
+
+std::vector<uint8_t> RewindBuffer::TakeStorage(size_t len)
+{
+	// Memory used is counted by capacity, so storage much bigger than
+	// needed, as a keyframe's is for a delta, is left for a bigger entry
+	for (size_t i = spare.size(); i-- > 0;)
+	{
+		if (spare[i].capacity() >= len && spare[i].capacity() <= len + len / 4)
+		{
+			std::vector<uint8_t> data = std::move(spare[i]);
+			spare.erase(spare.begin() + i);
+			return data;
+		}
+	}
+	std::vector<uint8_t> data;
+	data.reserve(len);
+	return data;
+}
+
+// Encoded as pairs of varints, unchanged words then changed words, each
+// followed by the xor of the changed words. Bytes past the last whole word
+// are stored xored at the end.
+void RewindBuffer::Encode(const uint8_t* prev, const uint8_t* next, size_t len, std::vector<uint8_t>& out)
+{
+	out.clear();
+	const size_t words = len / 8;
+	size_t word = 0;
+	while (word < words)
+	{
+		size_t start = word;
+		if (prev)
+			while (word < words && ReadWord(prev, word) == ReadWord(next, word))
+				word++;
+		else
+			while (word < words && ReadWord(next, word) == 0)
+				word++;
+		size_t skip = word - start;
+
+		start = word;
+		if (prev)
+			while (word < words && ReadWord(prev, word) != ReadWord(next, word))
+				word++;
+		else
+			while (word < words && ReadWord(next, word) != 0)
+				word++;
+		size_t changed = word - start;
+
+		WriteVarint(out, skip);
+		WriteVarint(out, changed);
+		for (size_t i = start; i < word; i++)
+		{
+			uint64_t x = ReadWord(next, i) ^ (prev ? ReadWord(prev, i) : 0);
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&x);
+			out.insert(out.end(), bytes, bytes + 8);
+		}
+	}
+	for (size_t i = words * 8; i < len; i++)
+		out.push_back(next[i] ^ (prev ? prev[i] : 0));
+}
+
+void RewindBuffer::Apply(const Entry& entry, uint8_t* state)
+{
+	const uint8_t* p = entry.data.data();
+	const size_t words = entry.stateSize / 8;
+	size_t word = 0;
+	while (word < words)
+	{
+		word += ReadVarint(p);
+		size_t changed = ReadVarint(p);
+		for (size_t i = 0; i < changed * 8; i++)
+			state[word * 8 + i] ^= p[i];
+		p += changed * 8;
+		word += changed;
+	}
+	for (size_t i = words * 8; i < entry.stateSize; i++)
+		state[i] ^= *p++;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "SaveStateUtil.h"
+
+// History of savestates for rewinding. Each entry is the xor of a state
+// with the one before it, with unchanged 8 byte words run length encoded,
+// and every so often a keyframe is stored against zero instead. The newest
+// state is kept whole so that stepping back only has to undo one delta,
+// and the oldest keyframe group is dropped once over the memory budget.
+// The storage of dropped entries is reused by later ones, so a full buffer
+// pushes without allocating.
+class RewindBuffer
+{
+public:
+	static constexpr int DEFAULT_KEYFRAME_INTERVAL = 64;
+
+	RewindBuffer(size_t budget, int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+	void Push(const Snapshot& state);
+	// Takes the newest state off the buffer, returns false when empty
+	bool Pop(Snapshot& state);
+	void Clear();
+	void SetBudget(size_t budget);
+	size_t Size() const;
+	size_t GetMemoryUsed() const;
+private:
+	struct Entry
+	{
+		std::vector<uint8_t> data;
+		size_t stateSize;
+		bool keyframe;
+	};
+	static void Encode(const uint8_t* prev, const uint8_t* next, size_t len, std::vector<uint8_t>& out);
+	static void Apply(const Entry& entry, uint8_t* state);
+	void Evict();
+	// Keeps a dropped entry's storage for reuse
+	void Recycle(std::vector<uint8_t>&& data);
+	// Storage for len bytes from a dropped entry, or new storage if none
+	// is close enough in size
+	std::vector<uint8_t> TakeStorage(size_t len);
+
+	std::deque<Entry> entries;
+	Snapshot newest;
+	std::vector<uint8_t> scratch;
+	std::vector<std::vector<uint8_t>> spare;
+	size_t budget;
+	size_t used = 0;
+	int keyframeInterval;
+	int sinceKeyframe = 0;
+};
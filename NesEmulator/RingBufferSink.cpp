@@ -0,0 +1,37 @@
+#include "RingBufferSink.h"
+#include <algorithm>
+
+RingBufferSink::RingBufferSink(SynthFunc synth, FilterFunc filter, int sampleRate) :
+	PacedSink(synth, filter, sampleRate)
+{
+	Start();
+}
+
+RingBufferSink::~RingBufferSink()
+{
+	Stop();
+}
+
+int RingBufferSink::GetLatencyMs() const
+{
+	return SamplesToMs(ring.Size());
+}
+
+size_t RingBufferSink::Read(Sample* out, size_t maxCount)
+{
+	size_t count = std::min(ring.Size(), maxCount);
+	ring.Peek(out, count);
+	ring.Pop(count);
+	return count;
+}
+
+size_t RingBufferSink::GetDroppedBlocks() const
+{
+	return droppedBlocks;
+}
+
+void RingBufferSink::ConsumeBlock(const Sample* block)
+{
+	if (!ring.Push(block, SAMPLES_PER_BLOCK))
+		droppedBlocks++;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "PacedSink.h"
+#include "SpscRing.h"
+
+// Keeps the most recent audio in memory so it can be inspected by another
+// thread. Blocks are dropped if the reader falls too far behind.
+class RingBufferSink : public PacedSink
+{
+public:
+	static constexpr size_t CAPACITY = 1 << 16;
+
+	RingBufferSink(SynthFunc synth, FilterFunc filter = nullptr, int sampleRate = DEFAULT_SAMPLE_RATE);
+	~RingBufferSink() override;
+	int GetLatencyMs() const override;
+	// Returns the number of samples read
+	size_t Read(Sample* out, size_t maxCount);
+	size_t GetDroppedBlocks() const;
+private:
+	void ConsumeBlock(const Sample* block) override;
+	SpscRing<Sample, CAPACITY> ring;
+	std::atomic<size_t> droppedBlocks = 0;
+};
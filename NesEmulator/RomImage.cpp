@@ -0,0 +1,60 @@
+#include "RomImage.h"
+#include <cstring>
+#include "Hash.h"
+
+std::mutex RomImage::registryMtx;
+std::unordered_map<uint64_t, std::weak_ptr<const RomImage>> RomImage::registry;
+
+std::shared_ptr<const RomImage> RomImage::Open(const std::wstring& filename)
+{
+	std::shared_ptr<const RomImage> image(new RomImage(filename));
+
+	std::unique_lock<std::mutex> lock(registryMtx);
+	for (auto it = registry.begin(); it != registry.end();)
+	{
+		if (it->second.expired())
+			it = registry.erase(it);
+		else
+			++it;
+	}
+
+	auto& entry = registry[image->hash];
+	if (auto existing = entry.lock())
+	{
+		// Only share on an exact match, a hash collision keeps its own image
+		if (existing->Size() == image->Size()
+			&& (image->Size() == 0 || std::memcmp(existing->Data(), image->Data(), image->Size()) == 0))
+			return existing;
+		return image;
+	}
+	entry = image;
+	return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::Find(uint64_t hash)
+{
+	std::unique_lock<std::mutex> lock(registryMtx);
+	auto it = registry.find(hash);
+	return it != registry.end() ? it->second.lock() : nullptr;
+}
+
+RomImage::RomImage(const std::wstring& filename) :
+	file(filename)
+{
+	hash = HashBytes(file.Data(), file.Size());
+}
+
+const uint8_t* RomImage::Data() const
+{
+	return file.Data();
+}
+
+size_t RomImage::Size() const
+{
+	return file.Size();
+}
+
+uint64_t RomImage::Hash() const
+{
+	return hash;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "MappedFile.h"
+
+// Read only memory mapping of a rom file. Views into it stay valid for as
+// long as a reference to the image is held.
+class RomImage
+{
+public:
+	// Images are shared process wide by content, so opening the same rom
+	// for several emulators maps it only once
+	static std::shared_ptr<const RomImage> Open(const std::wstring& filename);
+	// Returns the open image with this hash, or null if there is none
+	static std::shared_ptr<const RomImage> Find(uint64_t hash);
+	RomImage(const RomImage&) = delete;
+	RomImage& operator=(const RomImage&) = delete;
+	const uint8_t* Data() const;
+	size_t Size() const;
+	uint64_t Hash() const;
+private:
+	explicit RomImage(const std::wstring& filename);
+	MappedFile file;
+	uint64_t hash = 0;
+
+	// Open images by content hash, expired entries are pruned on open
+	static std::mutex registryMtx;
+	static std::unordered_map<uint64_t, std::weak_ptr<const RomImage>> registry;
+};
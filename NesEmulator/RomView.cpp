@@ -0,0 +1,56 @@
+#include "RomView.h"
+
+RomView::RomView(std::shared_ptr<const RomImage> image, size_t offset, size_t size) :
+	image(std::move(image)),
+	length(size)
+{
+	base = this->image->Data() + offset;
+}
+
+RomView::RomView(std::vector<uint8_t> bytes) :
+	owned(bytes.data(), bytes.size()),
+	length(bytes.size())
+{
+}
+
+bool RomView::IsShared() const
+{
+	return (bool)image;
+}
+
+size_t RomView::Offset() const
+{
+	return image ? (size_t)(base - image->Data()) : 0;
+}
+
+const PagedMemory& RomView::Owned() const
+{
+	return owned;
+}
+
+PagedMemory& RomView::Own(size_t size)
+{
+	image.reset();
+	base = nullptr;
+	if (owned.size() != size)
+		owned = PagedMemory(size);
+	length = size;
+	return owned;
+}
+
+RomView RomView::Fork() const
+{
+	RomView fork;
+	fork.image = image;
+	fork.owned = owned;
+	fork.base = base;
+	fork.length = length;
+	return fork;
+}
+
+void RomView::Detach()
+{
+	owned = PagedMemory(base, length);
+	base = nullptr;
+	image.reset();
+}
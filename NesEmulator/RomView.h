@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "RomImage.h"
+#include "PagedMemory.h"
+
+// A window of rom or ram that reads straight from a mapped rom image and
+// only takes its own copy the first time it is written to
+class RomView
+{
+public:
+	RomView() = default;
+	RomView(std::shared_ptr<const RomImage> image, size_t offset, size_t size);
+	// Owned writable memory, such as chr ram
+	explicit RomView(std::vector<uint8_t> bytes);
+	RomView(const RomView&) = delete;
+	RomView& operator=(const RomView&) = delete;
+	RomView(RomView&&) = default;
+	RomView& operator=(RomView&&) = default;
+
+	uint8_t operator[](size_t index) const
+	{
+		return base ? base[index] : owned[index];
+	}
+	size_t size() const
+	{
+		return length;
+	}
+	void Write(size_t index, uint8_t value)
+	{
+		if (base)
+			Detach();
+		owned.Write(index, value);
+	}
+	// True while the view still reads from the rom image
+	bool IsShared() const;
+	// Position of a shared view within its image
+	size_t Offset() const;
+	// The view's own copy, empty while it is shared
+	const PagedMemory& Owned() const;
+	// Turns the view into owned memory of the given size and returns it for
+	// writing, reusing the current copy when there is one
+	PagedMemory& Own(size_t size);
+	// A view of the same bytes whose own copy shares pages with this one
+	// until either of them writes
+	RomView Fork() const;
+private:
+	void Detach();
+	std::shared_ptr<const RomImage> image;
+	PagedMemory owned;
+	// Points into the image while the view is shared
+	const uint8_t* base = nullptr;
+	size_t length = 0;
+};
@@ -0,0 +1,254 @@
+#include "SRamJournal.h"
+#include <algorithm>
+#include <map>
+#include "EmuFileException.h"
+#include "Hash.h"
+
+// Journals open by path. An entry that has expired but is still listed is
+// being closed, and is waited for so that the save is folded before it
+// is read again.
+static std::mutex openMtx;
+static std::condition_variable openChanged;
+static std::map<std::wstring, std::weak_ptr<SRamJournal>> openJournals;
+
+std::shared_ptr<SRamJournal> SRamJournal::Open(const std::wstring& path, size_t size)
+{
+	std::error_code ec;
+	std::wstring key = std::filesystem::absolute(path, ec).lexically_normal().wstring();
+	if (ec)
+		key = path;
+
+	std::unique_lock<std::mutex> lock(openMtx);
+	std::shared_ptr<SRamJournal> journal;
+	openChanged.wait(lock, [&]
+	{
+		auto it = openJournals.find(key);
+		if (it == openJournals.end())
+			return true;
+		journal = it->second.lock();
+		return journal != nullptr;
+	});
+	if (journal)
+	{
+		if (journal->image.size() != size)
+			throw EmuFileException("sram is already open with a different size");
+		return journal;
+	}
+
+	journal = std::shared_ptr<SRamJournal>(new SRamJournal(path, size), [key](SRamJournal* closing)
+	{
+		delete closing;
+		{
+			std::unique_lock<std::mutex> lock(openMtx);
+			openJournals.erase(key);
+		}
+		openChanged.notify_all();
+	});
+	openJournals[key] = journal;
+	return journal;
+}
+
+SRamJournal::SRamJournal(const std::wstring& path, size_t size) :
+	path(path),
+	journalPath(path + L".journal"),
+	image(size)
+{
+	std::ifstream f(this->path, std::ios::binary | std::ios::ate);
+	if (f.is_open())
+	{
+		size_t len = std::min((size_t)f.tellg(), size);
+		f.seekg(0);
+		f.read(reinterpret_cast<char*>(image.data()), len);
+		loaded = !f.fail();
+	}
+	f.close();
+
+	// A journal left by a crash is folded in straight away so that the
+	// new one starts empty
+	std::error_code ec;
+	if (std::filesystem::exists(journalPath, ec))
+	{
+		Replay();
+		Fold();
+	}
+	thrd = std::thread(&SRamJournal::Run, this);
+}
+
+SRamJournal::~SRamJournal()
+{
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		foldRequested = true;
+		quit = true;
+	}
+	wake.notify_one();
+	if (thrd.joinable())
+		thrd.join();
+}
+
+bool SRamJournal::Loaded()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	return loaded;
+}
+
+std::vector<uint8_t> SRamJournal::Image()
+{
+	// The background thread only changes the image while it has records
+	std::unique_lock<std::mutex> lock(mtx);
+	idle.wait(lock, [this] { return jobs.empty() && !busy; });
+	return image;
+}
+
+void SRamJournal::Record(const PagedMemory& sram)
+{
+	std::vector<size_t> dirtyPages;
+	sram.TakeDirtyPages(dirtyPages);
+	if (dirtyPages.empty())
+		return;
+
+	std::vector<Page> pages;
+	for (size_t page : dirtyPages)
+	{
+		size_t offset = page * PagedMemory::PAGE_SIZE;
+		size_t n = std::min(PagedMemory::PAGE_SIZE, std::min(sram.size(), image.size()) - std::min(offset, image.size()));
+		if (n == 0)
+			continue;
+		pages.push_back({ (uint32_t)offset, std::vector<uint8_t>(n) });
+		sram.Read(offset, pages.back().bytes.data(), n);
+	}
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		jobs.push_back(std::move(pages));
+	}
+	wake.notify_one();
+}
+
+bool SRamJournal::Flush()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	foldRequested = true;
+	wake.notify_one();
+	idle.wait(lock, [this] { return jobs.empty() && !foldRequested && !busy; });
+	bool ok = !failed;
+	failed = false;
+	return ok;
+}
+
+void SRamJournal::Replay()
+{
+	// Records are applied in order up to the first one that is cut short
+	// or doesn't match its hash
+	std::ifstream f(journalPath, std::ios::binary);
+	RecordHeader header{};
+	std::vector<uint8_t> bytes;
+	while (f.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		if (header.magic != RecordHeader::MAGIC
+			|| header.offset > image.size()
+			|| header.size > image.size() - header.offset)
+			break;
+		bytes.resize(header.size);
+		f.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+		if (f.fail() || HashBytes(bytes.data(), bytes.size(), header.offset) != header.hash)
+			break;
+		std::copy(bytes.begin(), bytes.end(), image.begin() + header.offset);
+		loaded = true;
+		unsaved = true;
+	}
+}
+
+void SRamJournal::Run()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true)
+	{
+		wake.wait(lock, [this] { return quit || foldRequested || !jobs.empty(); });
+		if (jobs.empty() && !foldRequested)
+			return;
+
+		// Folds wait for the records queued before them
+		std::vector<Page> pages;
+		bool fold = jobs.empty();
+		if (fold)
+			foldRequested = false;
+		else
+		{
+			pages = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		busy = true;
+		lock.unlock();
+
+		bool ok = fold ? Fold() : Append(pages);
+		if (!fold && ok && journalSize > MAX_JOURNAL_SIZE)
+			ok = Fold();
+
+		lock.lock();
+		busy = false;
+		loaded |= !fold;
+		failed |= !ok;
+		idle.notify_all();
+	}
+}
+
+bool SRamJournal::Append(const std::vector<Page>& pages)
+{
+	for (const Page& page : pages)
+		std::copy(page.bytes.begin(), page.bytes.end(), image.begin() + page.offset);
+	unsaved = true;
+
+	if (!journal.is_open())
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(path.parent_path(), ec);
+		journal.clear();
+		journal.open(journalPath, std::ios::binary | std::ios::app);
+		if (!journal.is_open())
+			return false;
+	}
+	for (const Page& page : pages)
+	{
+		RecordHeader header{ RecordHeader::MAGIC, page.offset, (uint32_t)page.bytes.size(), HashBytes(page.bytes.data(), page.bytes.size(), page.offset) };
+		journal.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		journal.write(reinterpret_cast<const char*>(page.bytes.data()), page.bytes.size());
+		journalSize += sizeof(header) + page.bytes.size();
+	}
+	journal.flush();
+	return !journal.fail();
+}
+
+bool SRamJournal::Fold()
+{
+	// The save is replaced by renaming so that it is never half written.
+	// If the journal outlives a crash after this, replaying it again gives
+	// the same save.
+	if (!unsaved)
+		return true;
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	std::filesystem::path temp = path;
+	temp += L".tmp";
+	std::ofstream f(temp, std::ios::binary);
+	if (!f.is_open())
+		return false;
+	f.write(reinterpret_cast<const char*>(image.data()), image.size());
+	f.close();
+	if (f.fail())
+	{
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	std::filesystem::rename(temp, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+
+	journal.close();
+	std::filesystem::remove(journalPath, ec);
+	journalSize = 0;
+	unsaved = false;
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PagedMemory.h"
+
+// Keeps a battery save up to date on disk without the emulation thread
+// waiting for it. Sram pages written since the last record are copied and
+// appended by a background thread to a journal beside the save, and the
+// journal is folded into the save once it grows. Opening replays the
+// journal over the save, so a crash loses at most what hadn't been
+// recorded yet, and a record cut short by the crash is skipped.
+//
+// Each save has a single journal however many cartridges use it, so that
+// machines running the same game don't write over each other's records.
+class SRamJournal
+{
+public:
+	// Shares the journal already open for the path, or reads the save with
+	// the journal replayed over it. Sizes past the save's length are zero
+	// filled. The last owner to let go writes out everything recorded and
+	// folds the journal into the save.
+	static std::shared_ptr<SRamJournal> Open(const std::wstring& path, size_t size);
+	SRamJournal(const SRamJournal&) = delete;
+	SRamJournal& operator=(const SRamJournal&) = delete;
+	~SRamJournal();
+	// Whether there was a save or journal to read, or anything recorded
+	bool Loaded();
+	// Copy of the save with everything recorded so far
+	std::vector<uint8_t> Image();
+	// Queues a copy of the pages written since the last call. May be called
+	// from each owner's thread.
+	void Record(const PagedMemory& sram);
+	// Waits until everything recorded is in the save itself. Returns false
+	// if a write has failed since the last call.
+	bool Flush();
+private:
+	struct Page
+	{
+		uint32_t offset;
+		std::vector<uint8_t> bytes;
+	};
+	struct RecordHeader
+	{
+		static constexpr uint32_t MAGIC = 0x4C4E524A; // "JRNL"
+		uint32_t magic;
+		uint32_t offset;
+		uint32_t size;
+		// Of the bytes, seeded with the offset
+		uint64_t hash;
+	};
+	// The journal is folded into the save past this size
+	static constexpr uint64_t MAX_JOURNAL_SIZE = 64 * 1024;
+
+	SRamJournal(const std::wstring& path, size_t size);
+	void Replay();
+	void Run();
+	bool Append(const std::vector<Page>& pages);
+	bool Fold();
+
+	const std::filesystem::path path;
+	const std::filesystem::path journalPath;
+	// What the save holds once the journal is applied, kept by the
+	// background thread after opening
+	std::vector<uint8_t> image;
+	bool loaded = false;
+	// Whether the image has changed since it was last written to the save
+	bool unsaved = false;
+	std::ofstream journal;
+	uint64_t journalSize = 0;
+
+	std::deque<std::vector<Page>> jobs;
+	bool foldRequested = false;
+	bool busy = false;
+	bool failed = false;
+	bool quit = false;
+	std::mutex mtx;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::thread thrd;
+};
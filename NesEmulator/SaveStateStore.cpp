@@ -0,0 +1,187 @@
+#include "SaveStateStore.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include "StateContainer.h"
+
+SaveStateStore::SaveStateStore(const std::wstring& basePath, size_t slotCount, std::shared_ptr<ChunkStore> chunks) :
+	basePath(basePath),
+	chunks(std::move(chunks)),
+	slots(slotCount)
+{
+	thrd = std::thread(&SaveStateStore::Run, this);
+}
+
+SaveStateStore::~SaveStateStore()
+{
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		quit = true;
+	}
+	wake.notify_one();
+	if (thrd.joinable())
+		thrd.join();
+}
+
+void SaveStateStore::Save(int slot, const std::wstring& romFilename, Snapshot state)
+{
+	auto snapshot = std::make_shared<const Snapshot>(std::move(state));
+	std::unique_lock<std::mutex> lock(mtx);
+	slots[slot] = { SlotState::Ready, romFilename, snapshot };
+
+	// Only the newest of several queued writes to a slot needs to happen
+	auto queued = std::find_if(jobs.begin(), jobs.end(), [slot](const Job& job)
+	{
+		return job.write && job.slot == slot;
+	});
+	if (queued != jobs.end())
+	{
+		queued->romFilename = romFilename;
+		queued->snapshot = snapshot;
+		return;
+	}
+	lock.unlock();
+	Queue({ slot, true, romFilename, snapshot });
+}
+
+void SaveStateStore::Prefetch(int slot)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	if (slots[slot].state != SlotState::Unread)
+		return;
+	slots[slot].state = SlotState::Reading;
+	lock.unlock();
+	Queue({ slot, false });
+}
+
+bool SaveStateStore::Get(int slot, std::wstring& romFilename, std::shared_ptr<const Snapshot>& state)
+{
+	Prefetch(slot);
+	std::unique_lock<std::mutex> lock(mtx);
+	const Slot& saved = slots[slot];
+	if (saved.state == SlotState::Reading)
+		return false;
+	romFilename = saved.romFilename;
+	state = saved.snapshot;
+	return true;
+}
+
+bool SaveStateStore::PollCompletion(Completion& out)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	if (completions.empty())
+		return false;
+	out = std::move(completions.front());
+	completions.pop_front();
+	return true;
+}
+
+void SaveStateStore::Queue(Job job)
+{
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void SaveStateStore::Run()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true)
+	{
+		wake.wait(lock, [this] { return quit || !jobs.empty(); });
+		if (jobs.empty())
+			return;
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		lock.unlock();
+
+		Completion done{ job.slot, job.write, false, job.romFilename };
+		auto state = std::make_shared<Snapshot>();
+		if (job.write)
+			done.ok = WriteSlot(job);
+		else
+			done.ok = ReadSlot(job.slot, done.romFilename, *state);
+
+		lock.lock();
+		// A save made while the slot was being read is newer than the file
+		Slot& slot = slots[job.slot];
+		if (!job.write && slot.state == SlotState::Reading)
+		{
+			if (done.ok)
+				slot = { SlotState::Ready, done.romFilename, std::move(state) };
+			else
+				slot.state = SlotState::Missing;
+		}
+		completions.push_back(std::move(done));
+	}
+}
+
+bool SaveStateStore::WriteSlot(const Job& job) const
+{
+	Snapshot slot;
+	StateWriter bytes(slot);
+	size_t strLen = job.romFilename.size();
+	SaveBytes(bytes, strLen);
+	SaveBytes(bytes, job.romFilename.data(), strLen);
+	const size_t stateStart = bytes.Size();
+	bytes.Write(job.snapshot->data(), job.snapshot->size());
+
+	// Chunks start at each section so that sections which haven't changed
+	// are shared with other slots
+	std::vector<size_t> splits;
+	try
+	{
+		for (size_t offset : StateContainer(job.snapshot->data(), job.snapshot->size()).SectionOffsets())
+			splits.push_back(stateStart + offset);
+	}
+	catch (EmuFileException&)
+	{
+	}
+	splits.push_back(stateStart);
+
+	if (!chunks->Put(SlotName(job.slot), slot.data(), slot.size(), splits))
+		return false;
+	std::error_code ec;
+	std::filesystem::remove(SlotPath(job.slot), ec);
+	return true;
+}
+
+bool SaveStateStore::ReadSlot(int slot, std::wstring& romFilename, Snapshot& state) const
+{
+	Snapshot saved;
+	if (!chunks->Get(SlotName(slot), saved))
+	{
+		std::ifstream f(SlotPath(slot), std::ios::binary | std::ios::ate);
+		if (!f.is_open())
+			return false;
+		saved.resize((size_t)f.tellg());
+		f.seekg(0);
+		f.read(reinterpret_cast<char*>(saved.data()), saved.size());
+		if (f.fail() || f.bad())
+			return false;
+	}
+
+	StateReader bytes(saved);
+	size_t strLen = 0;
+	if (bytes.Remaining() < sizeof(strLen))
+		return false;
+	LoadBytes(bytes, strLen);
+	if (strLen > MAX_ROM_PATH || strLen * sizeof(wchar_t) > bytes.Remaining())
+		return false;
+	romFilename.resize(strLen);
+	LoadBytes(bytes, romFilename.data(), strLen);
+	state.assign(saved.end() - bytes.Remaining(), saved.end());
+	return true;
+}
+
+std::wstring SaveStateStore::SlotPath(int slot) const
+{
+	return basePath + std::to_wstring(slot);
+}
+
+std::wstring SaveStateStore::SlotName(int slot) const
+{
+	return L"slot" + std::to_wstring(slot);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ChunkStore.h"
+#include "SaveStateUtil.h"
+
+// Keeps the save slots in memory and does their file io on a background
+// thread, so saving and loading never wait on the disk. A save is seen by
+// loads straight away and written out afterwards to a chunk store, where
+// the parts of a state that other slots already hold aren't stored again.
+//
+// A slot holds the length of the rom's path, the path, and then the state.
+// Slots saved as whole files before the chunk store are still read, and
+// the file is removed once the slot is saved again. All calls are made
+// from one thread.
+class SaveStateStore
+{
+public:
+	// Older slot files are named basePath followed by the slot number. The
+	// chunk store can be shared with anything else storing states.
+	SaveStateStore(const std::wstring& basePath, size_t slotCount, std::shared_ptr<ChunkStore> chunks);
+	SaveStateStore(const SaveStateStore&) = delete;
+	SaveStateStore& operator=(const SaveStateStore&) = delete;
+	// Finishes any writes still queued
+	~SaveStateStore();
+	void Save(int slot, const std::wstring& romFilename, Snapshot state);
+	// Starts reading a slot that isn't in memory yet
+	void Prefetch(int slot);
+	// Gets a slot's state, or null if it has no readable file. Returns
+	// false while the slot is still being read, starting the read if needed.
+	bool Get(int slot, std::wstring& romFilename, std::shared_ptr<const Snapshot>& state);
+
+	struct Completion
+	{
+		int slot;
+		bool write;
+		bool ok;
+		std::wstring romFilename;
+	};
+	// Reports finished reads and writes in the order they finished
+	bool PollCompletion(Completion& out);
+private:
+	enum class SlotState { Unread, Reading, Ready, Missing };
+	struct Slot
+	{
+		SlotState state = SlotState::Unread;
+		std::wstring romFilename;
+		std::shared_ptr<const Snapshot> snapshot;
+	};
+	struct Job
+	{
+		int slot;
+		bool write;
+		std::wstring romFilename;
+		std::shared_ptr<const Snapshot> snapshot;
+	};
+	static constexpr size_t MAX_ROM_PATH = 32767;
+
+	void Run();
+	bool WriteSlot(const Job& job) const;
+	bool ReadSlot(int slot, std::wstring& romFilename, Snapshot& state) const;
+	std::wstring SlotPath(int slot) const;
+	std::wstring SlotName(int slot) const;
+	void Queue(Job job);
+
+	const std::wstring basePath;
+	const std::shared_ptr<ChunkStore> chunks;
+	std::vector<Slot> slots;
+	std::deque<Job> jobs;
+	std::deque<Completion> completions;
+	bool quit = false;
+	std::mutex mtx;
+	std::condition_variable wake;
+	std::thread thrd;
+};
@@ -1,41 +1,112 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <cstring>
 #include "EmuFileException.h"
 
 typedef std::vector<uint8_t> Snapshot;
 
-inline void AppendVector(Snapshot& vec, const Snapshot& app)
+// Appends fields to the end of a snapshot. Reserving the snapshot up front
+// means a whole state is written without reallocating.
+class StateWriter
 {
-	vec.insert(vec.end(), app.begin(), app.end());
-}
+public:
+	explicit StateWriter(Snapshot& buffer) :
+		buffer(buffer)
+	{
+	}
+
+	void Write(const void* data, size_t len)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + len);
+	}
+
+	// Overwrites bytes that have already been written
+	void Patch(size_t offset, const void* data, size_t len)
+	{
+		std::memcpy(buffer.data() + offset, data, len);
+	}
+
+	size_t Size() const
+	{
+		return buffer.size();
+	}
+
+	const uint8_t* Data() const
+	{
+		return buffer.data();
+	}
+private:
+	Snapshot& buffer;
+};
+
+// Reads fields in order from a buffer it does not own, moving a cursor
+// forward instead of erasing what has been read
+class StateReader
+{
+public:
+	StateReader() :
+		cursor(nullptr),
+		end(nullptr)
+	{
+	}
+
+	StateReader(const uint8_t* data, size_t len) :
+		cursor(data),
+		end(data + len)
+	{
+	}
+
+	explicit StateReader(const Snapshot& buffer) :
+		StateReader(buffer.data(), buffer.size())
+	{
+	}
+
+	void Read(void* data, size_t len)
+	{
+		if (Remaining() < len)
+			throw EmuFileException("invalid file, expected more bytes");
+		std::memcpy(data, cursor, len);
+		cursor += len;
+	}
+
+	void Skip(size_t len)
+	{
+		if (Remaining() < len)
+			throw EmuFileException("invalid file, expected more bytes");
+		cursor += len;
+	}
+
+	size_t Remaining() const
+	{
+		return (size_t)(end - cursor);
+	}
+private:
+	const uint8_t* cursor;
+	const uint8_t* end;
+};
 
 template <class T>
-static void SaveBytes(Snapshot& vec, const T& val)
+static void SaveBytes(StateWriter& writer, const T& val)
 {
-	vec.insert(vec.end(), reinterpret_cast<const uint8_t*>(&val), reinterpret_cast<const uint8_t*>(&val + 1));
+	writer.Write(&val, sizeof(val));
 }
 
 template <class T>
-static void SaveBytes(Snapshot& vec, const T* start, size_t len)
+static void SaveBytes(StateWriter& writer, const T* start, size_t len)
 {
-	vec.insert(vec.end(), reinterpret_cast<const uint8_t*>(start), reinterpret_cast<const uint8_t*>(start + len));
+	writer.Write(start, len * sizeof(T));
 }
 
 template <class T>
-static void LoadBytes(Snapshot& vec, T& val)
+static void LoadBytes(StateReader& reader, T& val)
 {
-	if (vec.size() < sizeof(val))
-		throw EmuFileException("invalid file, expected more bytes");
-	std::memcpy(&val, vec.data(), sizeof(val));
-	vec.erase(vec.begin(), vec.begin() + sizeof(val));
+	reader.Read(&val, sizeof(val));
 }
 
 template <class T>
-static void LoadBytes(Snapshot& vec, T* start, size_t len)
+static void LoadBytes(StateReader& reader, T* start, size_t len)
 {
-	if (vec.size() < len)
-		throw EmuFileException("invalid file, expected more bytes");
-	std::memcpy(start, vec.data(), len * sizeof(T));
-	vec.erase(vec.begin(), vec.begin() + len * sizeof(T));
+	reader.Read(start, len * sizeof(T));
 }
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Fixed size ring buffer for one producer thread and one consumer thread.
+// Neither side takes a lock; the indices only ever increase and are masked
+// on access.
+template <class T, size_t N>
+class SpscRing
+{
+	static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+public:
+	static constexpr size_t CAPACITY = N;
+
+	// Number of elements queued, safe to call from any thread
+	size_t Size() const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	// Producer side. Pushes all elements or none of them.
+	bool Push(const T* data, size_t count)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (N - (h - tail.load(std::memory_order_acquire)) < count)
+			return false;
+		for (size_t i = 0; i < count; i++)
+			buf[(h + i) & (N - 1)] = data[i];
+		head.store(h + count, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Copies the oldest elements without removing them.
+	void Peek(T* out, size_t count) const
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < count; i++)
+			out[i] = buf[(t + i) & (N - 1)];
+	}
+
+	// Consumer side
+	void Pop(size_t count)
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+private:
+	T buf[N]{};
+	alignas(64) std::atomic<size_t> head = 0;
+	alignas(64) std::atomic<size_t> tail = 0;
+};
@@ -0,0 +1,128 @@
+#include "StateContainer.h"
+#include <algorithm>
+#include <iterator>
+#include "EmuFileException.h"
+#include "Hash.h"
+
+StateContainerWriter::StateContainerWriter(StateWriter& bytes, int sectionCount) :
+	bytes(bytes),
+	start(bytes.Size()),
+	sectionCount(std::min(sectionCount, MAX_SECTIONS))
+{
+	// The header and table are patched in by Finish
+	StateHeader header{};
+	SaveBytes(bytes, header);
+	SaveBytes(bytes, table, this->sectionCount);
+}
+
+StateWriter& StateContainerWriter::Begin(uint32_t tag, uint16_t version)
+{
+	End();
+	current++;
+	if (current >= sectionCount)
+		throw EmuFileException("too many savestate sections");
+	table[current].tag = tag;
+	table[current].version = version;
+	table[current].offset = (uint32_t)(bytes.Size() - start);
+	return bytes;
+}
+
+void StateContainerWriter::End()
+{
+	if (current < 0)
+		return;
+	StateSection& section = table[current];
+	section.size = (uint32_t)(bytes.Size() - start) - section.offset;
+	section.checksum = HashBytes(bytes.Data() + start + section.offset, section.size);
+}
+
+void StateContainerWriter::Finish()
+{
+	End();
+	if (current != sectionCount - 1)
+		throw EmuFileException("missing savestate sections");
+	StateHeader header{ StateHeader::MAGIC, StateHeader::VERSION, (uint16_t)sectionCount, 0 };
+	header.checksum = HashBytes(table, sizeof(StateSection) * sectionCount);
+	bytes.Patch(start, &header, sizeof(header));
+	bytes.Patch(start + sizeof(header), table, sizeof(StateSection) * sectionCount);
+}
+
+StateContainer::StateContainer(const uint8_t* data, size_t size) :
+	data(data),
+	size(size)
+{
+	if (size < sizeof(header))
+		throw EmuFileException("invalid file");
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != StateHeader::MAGIC || header.version != StateHeader::VERSION)
+		throw EmuFileException("invalid file");
+
+	const size_t tableSize = sizeof(StateSection) * header.sectionCount;
+	if (header.sectionCount > StateContainerWriter::MAX_SECTIONS || size - sizeof(header) < tableSize)
+		throw EmuFileException("invalid file");
+	if (header.checksum != HashBytes(data + sizeof(header), tableSize))
+		throw EmuFileException("save state is corrupt");
+	std::memcpy(table, data + sizeof(header), tableSize);
+	for (int i = 0; i < header.sectionCount; i++)
+		if (table[i].offset > size || table[i].size > size - table[i].offset)
+			throw EmuFileException("invalid file");
+}
+
+StateContainer StateContainer::Open(const std::wstring& filename, size_t offset)
+{
+	return Open(std::make_shared<const MappedFile>(filename), offset);
+}
+
+StateContainer StateContainer::Open(std::shared_ptr<const MappedFile> file, size_t offset)
+{
+	if (offset > file->Size())
+		throw EmuFileException("invalid file");
+	StateContainer state(file->Data() + offset, file->Size() - offset);
+	state.file = std::move(file);
+	return state;
+}
+
+uint16_t StateContainer::Version() const
+{
+	return header.version;
+}
+
+bool StateContainer::Has(uint32_t tag) const
+{
+	return Find(tag) != nullptr;
+}
+
+uint16_t StateContainer::SectionVersion(uint32_t tag) const
+{
+	const StateSection* section = Find(tag);
+	if (!section)
+		throw EmuFileException("missing save state section");
+	return section->version;
+}
+
+StateReader StateContainer::Read(uint32_t tag) const
+{
+	const StateSection* section = Find(tag);
+	if (!section)
+		throw EmuFileException("missing save state section");
+	const uint8_t* bytes = data + section->offset;
+	if (section->checksum != HashBytes(bytes, section->size))
+		throw EmuFileException("save state is corrupt");
+	return StateReader(bytes, section->size);
+}
+
+std::vector<size_t> StateContainer::SectionOffsets() const
+{
+	std::vector<size_t> offsets;
+	for (int i = 0; i < header.sectionCount; i++)
+		offsets.push_back(table[i].offset);
+	return offsets;
+}
+
+const StateSection* StateContainer::Find(uint32_t tag) const
+{
+	for (int i = 0; i < header.sectionCount; i++)
+		if (table[i].tag == tag)
+			return &table[i];
+	return nullptr;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "SaveStateUtil.h"
+
+// Sections are named by four characters packed into a tag, as in "CPU "
+constexpr uint32_t StateTag(const char (&name)[5])
+{
+	return (uint32_t)(uint8_t)name[0]
+		| (uint32_t)(uint8_t)name[1] << 8
+		| (uint32_t)(uint8_t)name[2] << 16
+		| (uint32_t)(uint8_t)name[3] << 24;
+}
+
+// Savestates open with a header and a table of named sections, each with
+// its own version and checksum. The header's checksum covers the table,
+// so one section can be found and checked without reading the others.
+struct StateHeader
+{
+	static constexpr uint32_t MAGIC = 0x5353454E; // "NESS"
+	static constexpr uint16_t VERSION = 1;
+	uint32_t magic;
+	uint16_t version;
+	uint16_t sectionCount;
+	uint64_t checksum;
+};
+
+// Offsets are from the start of the header
+struct StateSection
+{
+	uint32_t tag;
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t offset;
+	uint32_t size;
+	uint64_t checksum;
+};
+
+// Writes the header and table around sections that are written one after
+// another
+class StateContainerWriter
+{
+public:
+	static constexpr int MAX_SECTIONS = 16;
+
+	StateContainerWriter(StateWriter& bytes, int sectionCount);
+	// Starts a section, which runs until the next one starts
+	StateWriter& Begin(uint32_t tag, uint16_t version);
+	// Fills in the table and checksums once every section is written
+	void Finish();
+private:
+	void End();
+	StateWriter& bytes;
+	const size_t start;
+	const int sectionCount;
+	int current = -1;
+	StateSection table[MAX_SECTIONS]{};
+};
+
+// Reads a savestate in place, from memory or a mapped file, without
+// copying it. The header and table are checked up front and each section
+// when it's read.
+class StateContainer
+{
+public:
+	StateContainer(const uint8_t* data, size_t size);
+	// Maps a state file whose state starts offset bytes in
+	static StateContainer Open(const std::wstring& filename, size_t offset = 0);
+	static StateContainer Open(std::shared_ptr<const MappedFile> file, size_t offset = 0);
+	uint16_t Version() const;
+	bool Has(uint32_t tag) const;
+	uint16_t SectionVersion(uint32_t tag) const;
+	// Checks the section's checksum and returns a reader over it
+	StateReader Read(uint32_t tag) const;
+	// Where each section starts, from the start of the header
+	std::vector<size_t> SectionOffsets() const;
+private:
+	const StateSection* Find(uint32_t tag) const;
+	std::shared_ptr<const MappedFile> file;
+	const uint8_t* data;
+	size_t size;
+	StateHeader header{};
+	StateSection table[StateContainerWriter::MAX_SECTIONS]{};
+};
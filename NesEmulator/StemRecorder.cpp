@@ -0,0 +1,57 @@
+#include "StemRecorder.h"
+#include <algorithm>
+#include <chrono>
+
+StemRecorder::StemRecorder(const std::filesystem::path& path, int sampleRate) :
+	writer(path, sampleRate, CHANNELS),
+	writeBuffer(decltype(ring)::CAPACITY)
+{
+	thrd = std::thread(&StemRecorder::Run, this);
+}
+
+StemRecorder::~StemRecorder()
+{
+	thrdActive = false;
+	if (thrd.joinable())
+		thrd.join();
+	writer.Close();
+}
+
+void StemRecorder::PushFrame(const Sample frame[CHANNELS])
+{
+	if (!ring.Push(frame, CHANNELS))
+		droppedFrames++;
+}
+
+size_t StemRecorder::GetDroppedFrames() const
+{
+	return droppedFrames;
+}
+
+bool StemRecorder::Failed() const
+{
+	return failed;
+}
+
+void StemRecorder::Run()
+{
+	while (thrdActive)
+	{
+		WritePending();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	WritePending();
+}
+
+void StemRecorder::WritePending()
+{
+	// Frames are pushed whole so the count is always a multiple of CHANNELS
+	size_t count = std::min(ring.Size(), writeBuffer.size());
+	count -= count % CHANNELS;
+	if (count == 0)
+		return;
+	ring.Peek(writeBuffer.data(), count);
+	ring.Pop(count);
+	if (!failed && !writer.Write(writeBuffer.data(), count / CHANNELS))
+		failed = true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include "AudioSink.h"
+#include "SpscRing.h"
+#include "WavWriter.h"
+
+// Records the mixed apu output alongside each channel on its own as a
+// multi-channel wav. The emulation thread only pushes into a preallocated
+// ring; a background thread does all of the file io.
+class StemRecorder
+{
+public:
+	// Mix, Pulse1, Pulse2, Triangle, Noise
+	static constexpr int CHANNELS = 5;
+
+	StemRecorder(const std::filesystem::path& path, int sampleRate);
+	StemRecorder(const StemRecorder&) = delete;
+	StemRecorder& operator=(const StemRecorder&) = delete;
+	~StemRecorder();
+	// Called from the emulation thread, never blocks
+	void PushFrame(const Sample frame[CHANNELS]);
+	size_t GetDroppedFrames() const;
+	bool Failed() const;
+private:
+	void Run();
+	void WritePending();
+	WavWriter writer;
+	SpscRing<Sample, (1 << 17)> ring;
+	std::vector<Sample> writeBuffer;
+	std::thread thrd;
+	std::atomic_bool thrdActive = true;
+	std::atomic_bool failed = false;
+	std::atomic<size_t> droppedFrames = 0;
+};
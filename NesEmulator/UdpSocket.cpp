@@ -0,0 +1,166 @@
+#include "UdpSocket.h"
+#include <cstring>
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <mstcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static void CloseSocket(SocketHandle s)
+{
+	closesocket(s);
+	WSACleanup();
+}
+
+static int LastSocketError()
+{
+	return WSAGetLastError();
+}
+
+static bool WouldBlock(int error)
+{
+	return error == WSAEWOULDBLOCK;
+}
+
+// Errors that only concern the datagram being read, which is dropped
+static bool DropsDatagram(int error)
+{
+	return error == WSAEMSGSIZE || error == WSAECONNRESET;
+}
+#else
+using SocketHandle = int;
+static constexpr SocketHandle INVALID_SOCKET = -1;
+static void CloseSocket(SocketHandle s)
+{
+	close(s);
+}
+
+static int LastSocketError()
+{
+	return errno;
+}
+
+static bool WouldBlock(int error)
+{
+	return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+// Errors that only concern the datagram being read, which is dropped
+static bool DropsDatagram(int error)
+{
+	return error == EINTR || error == ECONNREFUSED;
+}
+#endif
+
+static_assert(sizeof(sockaddr_in) <= 16, "peer address must fit in the socket");
+
+NetworkException::NetworkException(const std::string& msg) :
+	msg(msg)
+{
+}
+
+const char* NetworkException::what() const noexcept
+{
+	return msg.c_str();
+}
+
+UdpSocket::UdpSocket(uint16_t localPort, const std::string& remoteHost, uint16_t remotePort)
+{
+#ifdef _WIN32
+	WSADATA wsaData{};
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		throw NetworkException("could not initialise sockets");
+#endif
+
+	// Only IPv4 is needed to reach a peer on a LAN or loopback
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* found = nullptr;
+	std::string service = std::to_string(remotePort);
+	if (getaddrinfo(remoteHost.c_str(), service.c_str(), &hints, &found) != 0 || !found)
+	{
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		throw NetworkException("could not resolve " + remoteHost);
+	}
+	std::memcpy(remoteAddress, found->ai_addr, sizeof(sockaddr_in));
+	freeaddrinfo(found);
+
+	SocketHandle s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET)
+	{
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		throw NetworkException("could not create socket");
+	}
+
+	sockaddr_in local{};
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(localPort);
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	bool configured = ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+	// Windows otherwise fails the next read with WSAECONNRESET whenever a
+	// send draws a port unreachable, as it does until the peer has started
+	BOOL reportReset = FALSE;
+	DWORD returned = 0;
+	configured = configured && WSAIoctl(s, SIO_UDP_CONNRESET, &reportReset, sizeof(reportReset), nullptr, 0, &returned, nullptr, nullptr) == 0;
+#else
+	bool configured = fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+	if (!configured || bind(s, (const sockaddr*)&local, sizeof(local)) != 0)
+	{
+		CloseSocket(s);
+		throw NetworkException("could not bind port " + std::to_string(localPort));
+	}
+	handle = (uintptr_t)s;
+}
+
+UdpSocket::~UdpSocket()
+{
+	CloseSocket((SocketHandle)handle);
+}
+
+void UdpSocket::Send(const void* data, size_t size)
+{
+	// Lost datagrams are expected, so failures are left to the caller's
+	// resending rather than reported
+	sendto((SocketHandle)handle, (const char*)data, (int)size, 0, (const sockaddr*)remoteAddress, sizeof(sockaddr_in));
+}
+
+size_t UdpSocket::Receive(void* data, size_t capacity)
+{
+	while (true)
+	{
+		sockaddr_in from{};
+		socklen_t fromSize = sizeof(from);
+		auto received = recvfrom((SocketHandle)handle, (char*)data, (int)capacity, 0, (sockaddr*)&from, &fromSize);
+		if (received < 0)
+		{
+			int error = LastSocketError();
+			if (WouldBlock(error))
+				return 0;
+			if (DropsDatagram(error))
+				continue;
+			throw NetworkException("could not receive from peer (error " + std::to_string(error) + ")");
+		}
+
+		const auto& peer = *(const sockaddr_in*)remoteAddress;
+		if (received > 0 && from.sin_addr.s_addr == peer.sin_addr.s_addr && from.sin_port == peer.sin_port)
+			return (size_t)received;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <string>
+
+class NetworkException : public std::exception
+{
+public:
+	NetworkException(const std::string& msg = "a network error occurred");
+	const char* what() const noexcept override;
+private:
+	std::string msg;
+};
+
+// Non-blocking UDP socket talking to a single peer
+class UdpSocket
+{
+public:
+	UdpSocket(uint16_t localPort, const std::string& remoteHost, uint16_t remotePort);
+	UdpSocket(const UdpSocket&) = delete;
+	UdpSocket& operator=(const UdpSocket&) = delete;
+	~UdpSocket();
+	void Send(const void* data, size_t size);
+	// Returns the size of the next datagram from the peer, or 0 if there
+	// is none waiting. Datagrams from anyone else are dropped. Throws if
+	// the socket itself fails.
+	size_t Receive(void* data, size_t capacity);
+	static constexpr size_t MAX_DATAGRAM_SIZE = 512;
+private:
+	uintptr_t handle;
+	alignas(8) uint8_t remoteAddress[16]{};
+};
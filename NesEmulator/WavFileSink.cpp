@@ -0,0 +1,23 @@
+#include "WavFileSink.h"
+
+WavFileSink::WavFileSink(const std::filesystem::path& path, SynthFunc synth, FilterFunc filter, int sampleRate) :
+	PacedSink(synth, filter, sampleRate),
+	writer(path, sampleRate, CHANNELS)
+{
+	Start();
+}
+
+WavFileSink::~WavFileSink()
+{
+	Stop();
+}
+
+int WavFileSink::GetLatencyMs() const
+{
+	return 0;
+}
+
+void WavFileSink::ConsumeBlock(const Sample* block)
+{
+	writer.Write(block, SAMPLES_PER_BLOCK);
+}
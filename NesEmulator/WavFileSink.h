@@ -0,0 +1,16 @@
+#pragma once
+#include <filesystem>
+#include "PacedSink.h"
+#include "WavWriter.h"
+
+// Records audio to a wav file in real time
+class WavFileSink : public PacedSink
+{
+public:
+	WavFileSink(const std::filesystem::path& path, SynthFunc synth, FilterFunc filter = nullptr, int sampleRate = DEFAULT_SAMPLE_RATE);
+	~WavFileSink() override;
+	int GetLatencyMs() const override;
+private:
+	void ConsumeBlock(const Sample* block) override;
+	WavWriter writer;
+};
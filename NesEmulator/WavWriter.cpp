@@ -0,0 +1,77 @@
+#include "WavWriter.h"
+#include "EmuFileException.h"
+
+WavWriter::WavWriter(const std::filesystem::path& path, int sampleRate, int channels) :
+	file(path, std::ios::binary | std::ios::trunc),
+	sampleRate(sampleRate),
+	channels(channels)
+{
+	if (!file.is_open())
+		throw EmuFileException("failed to create wav file");
+	WriteHeader();
+}
+
+WavWriter::~WavWriter()
+{
+	Close();
+}
+
+bool WavWriter::Write(const Sample* frames, size_t frameCount)
+{
+	if (!file.is_open())
+		return false;
+
+	// Wav data is little endian
+	size_t count = frameCount * channels;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint16_t s = (uint16_t)frames[i];
+		char bytes[2] = { (char)(s & 0xFF), (char)(s >> 8) };
+		file.write(bytes, 2);
+	}
+	dataBytes += (uint32_t)(count * sizeof(Sample));
+	return (bool)file;
+}
+
+void WavWriter::Close()
+{
+	if (!file.is_open())
+		return;
+	file.seekp(0);
+	WriteHeader();
+	file.close();
+}
+
+size_t WavWriter::GetFrameCount() const
+{
+	return dataBytes / (sizeof(Sample) * channels);
+}
+
+void WavWriter::WriteHeader()
+{
+	auto Write32 = [&](uint32_t n)
+	{
+		char bytes[4] = { (char)(n & 0xFF), (char)((n >> 8) & 0xFF), (char)((n >> 16) & 0xFF), (char)(n >> 24) };
+		file.write(bytes, 4);
+	};
+	auto Write16 = [&](uint16_t n)
+	{
+		char bytes[2] = { (char)(n & 0xFF), (char)(n >> 8) };
+		file.write(bytes, 2);
+	};
+
+	const uint16_t blockAlign = (uint16_t)(channels * sizeof(Sample));
+	file.write("RIFF", 4);
+	Write32(36 + dataBytes);
+	file.write("WAVE", 4);
+	file.write("fmt ", 4);
+	Write32(16);
+	Write16(1); // pcm
+	Write16((uint16_t)channels);
+	Write32((uint32_t)sampleRate);
+	Write32((uint32_t)sampleRate * blockAlign);
+	Write16(blockAlign);
+	Write16(AudioSink::BITS_PER_SAMPLE);
+	file.write("data", 4);
+	Write32(dataBytes);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include "AudioSink.h"
+
+// Streams 16 bit pcm to a wav file. The header sizes are patched when the
+// file is closed so that a file cut short is still mostly readable.
+class WavWriter
+{
+public:
+	WavWriter(const std::filesystem::path& path, int sampleRate, int channels = 1);
+	WavWriter(const WavWriter&) = delete;
+	WavWriter& operator=(const WavWriter&) = delete;
+	~WavWriter();
+	// Samples are interleaved by channel. Returns false if the write failed.
+	bool Write(const Sample* frames, size_t frameCount);
+	void Close();
+	size_t GetFrameCount() const;
+private:
+	void WriteHeader();
+	std::ofstream file;
+	int sampleRate;
+	int channels;
+	uint32_t dataBytes = 0;
+};
@@ -1,44 +1,39 @@
-#include "Audio.h"
+#include "WaveOutSink.h"
 #pragma comment(lib, "winmm.lib")
 
-AudioException::AudioException(const std::string& msg) :
-	msg(msg)
+WaveOutSink::WaveOutSink(SynthFunc synth, FilterFunc filter, int sampleRate) :
+	AudioSink(synth, filter, sampleRate)
 {
-}
-
-const char* AudioException::what() const noexcept
-{
-	return msg.c_str();
-}
-
-Audio::Audio(SynthFunc synth, FilterFunc filter)
-{
-	this->synth = synth;
-	this->filter = filter;
 	if (!InitialiseAudio())
 		throw AudioException("failed to initialise audio");
 }
 
-Audio::~Audio()
+WaveOutSink::~WaveOutSink()
 {
 	DestroyAudio();
 }
 
-bool Audio::InitialiseAudio()
+int WaveOutSink::GetLatencyMs() const
+{
+	// Blocks handed to the device that have not finished playing
+	return SamplesToMs((size_t)(BLOCK_COUNT - blocksFree) * SAMPLES_PER_BLOCK);
+}
+
+bool WaveOutSink::InitialiseAudio()
 {
 	thrdActive = false;
 	blocksFree = BLOCK_COUNT;
 
 	WAVEFORMATEX wf;
 	wf.wFormatTag = WAVE_FORMAT_PCM;
-	wf.nSamplesPerSec = SAMPLE_RATE;
+	wf.nSamplesPerSec = GetSampleRate();
 	wf.wBitsPerSample = BITS_PER_SAMPLE;
 	wf.nChannels = CHANNELS;
 	wf.nBlockAlign = (wf.wBitsPerSample / 8) * wf.nChannels;
 	wf.nAvgBytesPerSec = wf.nSamplesPerSec * wf.nBlockAlign;
 	wf.cbSize = 0;
 
-	if (waveOutOpen(&device, WAVE_MAPPER, &wf, (DWORD_PTR)Audio::WaveOutProc, (DWORD_PTR)this, CALLBACK_FUNCTION) != S_OK)
+	if (waveOutOpen(&device, WAVE_MAPPER, &wf, (DWORD_PTR)WaveOutSink::WaveOutProc, (DWORD_PTR)this, CALLBACK_FUNCTION) != S_OK)
 	{
 		DestroyAudio();
 		return false;
@@ -54,22 +49,22 @@ bool Audio::InitialiseAudio()
 	}
 
 	thrdActive = true;
-	thrd = std::thread(&Audio::Run, this);
+	thrd = std::thread(&WaveOutSink::Run, this);
 	std::unique_lock<std::mutex> lock(mtx);
 	cv.notify_one();
 	return true;
 }
 
-void Audio::DestroyAudio()
+void WaveOutSink::DestroyAudio()
 {
 	thrdActive = false;
 	if (thrd.joinable())
 		thrd.join();
 }
 
-void CALLBACK Audio::WaveOutProc(HWAVEOUT device, UINT msg, DWORD_PTR inst, DWORD_PTR param1, DWORD_PTR param2)
+void CALLBACK WaveOutSink::WaveOutProc(HWAVEOUT device, UINT msg, DWORD_PTR inst, DWORD_PTR param1, DWORD_PTR param2)
 {
-	auto audio = (Audio*)inst;
+	auto audio = (WaveOutSink*)inst;
 	switch (msg)
 	{
 	case WOM_DONE:
@@ -88,10 +83,9 @@ void CALLBACK Audio::WaveOutProc(HWAVEOUT device, UINT msg, DWORD_PTR inst, DWOR
 	}
 }
 
-void Audio::Run()
+void WaveOutSink::Run()
 {
 	int curBlock = 0;
-	std::vector<float> tmpBuffer(SAMPLES_PER_BLOCK);
 	while (thrdActive)
 	{
 		// Wait for block to become available
@@ -107,21 +101,7 @@ void Audio::Run()
 		if (waveHeaders[curBlock].dwFlags & WHDR_PREPARED)
 			waveOutUnprepareHeader(device, &waveHeaders[curBlock], sizeof(WAVEHDR));
 
-		synth(tmpBuffer.data());
-		if (filter)
-			filter(tmpBuffer.data());
-
-		auto Clamp = [](float val)
-		{
-			if (val < -1.0f)
-				return -1.0f;
-			else if (val >= 1.0f)
-				return 1.0f;
-			else
-				return val;
-		};
-		for (size_t i = 0; i < SAMPLES_PER_BLOCK; i++)
-			blocks[curBlock * SAMPLES_PER_BLOCK + i] = (Sample)(Clamp(tmpBuffer[i]) * std::numeric_limits<Sample>::max());
+		RenderBlock(blocks.data() + curBlock * SAMPLES_PER_BLOCK);
 
 		// Send block to audio device
 		waveOutPrepareHeader(device, &waveHeaders[curBlock], sizeof(WAVEHDR));
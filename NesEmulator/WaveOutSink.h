@@ -0,0 +1,35 @@
+#pragma once
+#include <condition_variable>
+#include <Windows.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "AudioSink.h"
+#undef min
+#undef max
+
+// Plays audio through the default waveOut device
+class WaveOutSink : public AudioSink
+{
+public:
+	static constexpr int BLOCK_COUNT = 3;
+
+	WaveOutSink(SynthFunc synth, FilterFunc filter = nullptr, int sampleRate = DEFAULT_SAMPLE_RATE);
+	~WaveOutSink() override;
+	int GetLatencyMs() const override;
+private:
+	static void CALLBACK WaveOutProc(HWAVEOUT device, UINT msg, DWORD_PTR inst, DWORD_PTR param1, DWORD_PTR param2);
+	bool InitialiseAudio();
+	void DestroyAudio();
+	std::vector<Sample> blocks;
+	std::vector<WAVEHDR> waveHeaders;
+	HWAVEOUT device;
+	std::atomic_int blocksFree;
+	std::condition_variable cv;
+	std::mutex mtx;
+
+	void Run();
+	std::thread thrd;
+	std::atomic_bool thrdActive;
+	std::atomic_bool deviceClosed;
+};
@@ -0,0 +1,96 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "NsfPlayer.h"
+#include "EmuFileException.h"
+
+// Pixels are never drawn without a ppu
+void DrawPixel(int x, int y, uint8_t c)
+{
+}
+
+static void PrintUsage()
+{
+	std::wcout <<
+		L"usage: NsfPlayer <file.nsf> [options]\n"
+		L"  -o <dir>      output directory (default: current directory)\n"
+		L"  -t <seconds>  length of each track (default: 120)\n"
+		L"  -r <rate>     sample rate, 44100, 48000 or 96000 (default: 44100)\n"
+		L"  -n <track>    render only this track, starting from 1\n";
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::wstring filename = argv[1];
+	std::filesystem::path outDir = L".";
+	float seconds = 120.0f;
+	int sampleRate = AudioSink::DEFAULT_SAMPLE_RATE;
+	int onlyTrack = -1;
+	try
+	{
+		for (int i = 2; i + 1 < argc; i += 2)
+		{
+			std::wstring opt = argv[i];
+			if (opt == L"-o")
+				outDir = argv[i + 1];
+			else if (opt == L"-t")
+				seconds = std::stof(argv[i + 1]);
+			else if (opt == L"-r")
+				sampleRate = std::stoi(argv[i + 1]);
+			else if (opt == L"-n")
+				onlyTrack = std::stoi(argv[i + 1]) - 1;
+			else
+				throw std::invalid_argument("unknown option");
+		}
+	}
+	catch (std::exception&)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		NsfPlayer player(filename, sampleRate);
+		const auto& nsf = player.GetFile();
+		std::cout << nsf.name << " - " << nsf.artist << " (" << nsf.trackCount << " tracks)" << std::endl;
+		if (nsf.extraSoundChips)
+			std::cout << "warning: expansion audio is not supported and will be silent" << std::endl;
+
+		std::error_code ec;
+		std::filesystem::create_directories(outDir, ec);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int track = 0; track < nsf.trackCount; track++)
+		{
+			if (onlyTrack >= 0 && track != onlyTrack)
+				continue;
+
+			std::wstring number = std::to_wstring(track + 1);
+			if (number.size() < 2)
+				number = L"0" + number;
+			auto outFile = outDir / (std::filesystem::path(filename).stem().wstring() + L" - " + number + L".wav");
+			player.RenderTrack(track, seconds, outFile);
+			std::wcout << L"wrote " << outFile.wstring() << std::endl;
+		}
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+		std::wcout << L"done in " << elapsed.count() << L"s" << std::endl;
+	}
+	catch (EmuFileException& e)
+	{
+		std::cout << "error: " << e.what() << std::endl;
+		return 1;
+	}
+	catch (AudioException& e)
+	{
+		std::cout << "error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "NsfFile.h"
+#include <cstring>
+#include <fstream>
+#include "EmuFileException.h"
+
+NsfFile::NsfFile(const std::wstring& filename)
+{
+	// Load file
+	std::ifstream f(filename, std::ios::binary | std::ios::ate);
+	if (!f.is_open())
+		throw EmuFileException("could not open file");
+	size_t len = static_cast<size_t>(f.tellg());
+	std::vector<uint8_t> bytes(len);
+	f.seekg(0, std::ios::beg);
+	f.read(reinterpret_cast<char*>(bytes.data()), len);
+	if (f.bad() || f.fail())
+		throw EmuFileException("error reading file");
+
+	// Extract header
+	Header header;
+	if (bytes.size() <= sizeof(header))
+		throw EmuFileException("invalid file format");
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (std::memcmp(header.signature, "NESM\x1A", 5) != 0)
+		throw EmuFileException("invalid file format");
+
+	auto Word = [](const uint8_t bytes[2])
+	{
+		return (uint16_t)(bytes[0] | (bytes[1] << 8));
+	};
+	auto String = [](const char* chars, size_t maxLen)
+	{
+		return std::string(chars, strnlen(chars, maxLen));
+	};
+
+	trackCount = header.trackCount;
+	startingTrack = header.startingTrack ? header.startingTrack - 1 : 0;
+	loadAddr = Word(header.loadAddr);
+	initAddr = Word(header.initAddr);
+	playAddr = Word(header.playAddr);
+	playPeriodUs = Word(header.ntscSpeed);
+	std::memcpy(initialBanks, header.bankswitch, sizeof(initialBanks));
+	extraSoundChips = header.extraSoundChips;
+	name = String(header.name, sizeof(header.name));
+	artist = String(header.artist, sizeof(header.artist));
+	copyright = String(header.copyright, sizeof(header.copyright));
+	data.assign(bytes.begin() + sizeof(header), bytes.end());
+
+	if (trackCount == 0)
+		throw EmuFileException("nsf has no tracks");
+	if (!IsBanked() && loadAddr < 0x8000)
+		throw EmuFileException("unsupported nsf load address");
+	if (!IsBanked() && data.size() > 0x10000u - loadAddr)
+		throw EmuFileException("nsf data does not fit in memory");
+
+	// Most players treat a missing rate as 60Hz
+	if (playPeriodUs == 0)
+		playPeriodUs = 16639;
+}
+
+bool NsfFile::IsBanked() const
+{
+	for (uint8_t bank : initialBanks)
+		if (bank)
+			return true;
+	return false;
+}
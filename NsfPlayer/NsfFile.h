@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Contents of an nsf music file
+class NsfFile
+{
+public:
+	NsfFile(const std::wstring& filename);
+	bool IsBanked() const;
+
+	int trackCount = 0;
+	int startingTrack = 0;
+	uint16_t loadAddr = 0;
+	uint16_t initAddr = 0;
+	uint16_t playAddr = 0;
+	uint16_t playPeriodUs = 0;
+	uint8_t initialBanks[8]{};
+	uint8_t extraSoundChips = 0;
+	std::string name;
+	std::string artist;
+	std::string copyright;
+	std::vector<uint8_t> data;
+private:
+	struct Header
+	{
+		uint8_t signature[5];
+		uint8_t version;
+		uint8_t trackCount;
+		uint8_t startingTrack;
+		uint8_t loadAddr[2];
+		uint8_t initAddr[2];
+		uint8_t playAddr[2];
+		char name[32];
+		char artist[32];
+		char copyright[32];
+		uint8_t ntscSpeed[2];
+		uint8_t bankswitch[8];
+		uint8_t palSpeed[2];
+		uint8_t palNtscBits;
+		uint8_t extraSoundChips;
+		uint8_t padding[4];
+	};
+	static_assert(sizeof(Header) == 0x80, "nsf header must be 128 bytes");
+};
@@ -0,0 +1,70 @@
+#include "NsfMapper.h"
+#include <algorithm>
+
+NsfMapper::NsfMapper(const NsfFile& nsf, RomView& prg, RomView& chr) :
+	Mapper(MAPPER_NUMBER, 0, 0, prg, chr),
+	wram(0x2000)
+{
+	// Banked files are padded within their first bank, others are placed
+	// at their load address with banks 0-7 mapped in order
+	size_t padding;
+	if (nsf.IsBanked())
+	{
+		padding = nsf.loadAddr & 0x0FFF;
+		std::copy(std::begin(nsf.initialBanks), std::end(nsf.initialBanks), initialBanks);
+	}
+	else
+	{
+		padding = nsf.loadAddr - 0x8000;
+		for (uint8_t i = 0; i < 8; i++)
+			initialBanks[i] = i;
+	}
+
+	size_t size = (padding + nsf.data.size() + 0x0FFF) & ~(size_t)0x0FFF;
+	std::vector<uint8_t> image(std::max(size, (size_t)0x8000), 0);
+	std::copy(nsf.data.begin(), nsf.data.end(), image.begin() + padding);
+	prg = RomView(std::move(image));
+	prgChunks = (int)(prg.size() / 0x4000);
+	Reset();
+}
+
+bool NsfMapper::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly)
+{
+	if (addr >= 0x8000)
+	{
+		size_t offset = banks[(addr - 0x8000) >> 12] * 0x1000 + (addr & 0x0FFF);
+		data = offset < prg.size() ? prg[offset] : 0;
+		return true;
+	}
+	else if (addr >= 0x6000)
+	{
+		data = wram[addr - 0x6000];
+		return true;
+	}
+	return false;
+}
+
+bool NsfMapper::MapCpuWrite(uint16_t& addr, uint8_t data)
+{
+	if (addr >= 0x8000)
+	{
+		return true;
+	}
+	else if (addr >= 0x6000)
+	{
+		wram[addr - 0x6000] = data;
+		return true;
+	}
+	else if (addr >= 0x5FF8)
+	{
+		banks[addr - 0x5FF8] = data;
+		return true;
+	}
+	return false;
+}
+
+void NsfMapper::Reset()
+{
+	std::copy(std::begin(initialBanks), std::end(initialBanks), banks);
+	std::fill(wram.begin(), wram.end(), 0);
+}
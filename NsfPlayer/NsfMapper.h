@@ -0,0 +1,21 @@
+#pragma once
+#include "Mapper.h"
+#include "NsfFile.h"
+
+// Maps nsf data into $8000-$FFFF in 4KB banks switched through
+// $5FF8-$5FFF, along with 8KB of work ram at $6000-$7FFF
+class NsfMapper : public Mapper
+{
+public:
+	static constexpr int MAPPER_NUMBER = -1;
+
+	// Lays out the nsf data in prg so that banks line up with 4KB boundaries
+	NsfMapper(const NsfFile& nsf, RomView& prg, RomView& chr);
+	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
+	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
+	void Reset() override;
+private:
+	uint8_t initialBanks[8]{};
+	uint8_t banks[8]{};
+	std::vector<uint8_t> wram;
+};
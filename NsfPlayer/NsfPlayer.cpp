@@ -0,0 +1,117 @@
+#include "NsfPlayer.h"
+#include <algorithm>
+#include <cstring>
+#include "AudioMixer.h"
+#include "NsfMapper.h"
+#include "WavWriter.h"
+
+NsfPlayer::NsfPlayer(const std::wstring& filename, int sampleRate) :
+	nsf(filename),
+	nes(L""),
+	sampleRate(sampleRate)
+{
+	if (!AudioSink::IsSupportedSampleRate(sampleRate))
+		throw AudioException("unsupported sample rate");
+
+	auto cart = std::shared_ptr<Cartridge>(new Cartridge(filename));
+	cart->mapper = std::make_unique<NsfMapper>(nsf, cart->prg, cart->chr);
+	nes.cart = cart;
+	nes.cpu = std::make_unique<Cpu>(nes);
+}
+
+const NsfFile& NsfPlayer::GetFile() const
+{
+	return nsf;
+}
+
+void NsfPlayer::RenderTrack(int track, float seconds, const std::filesystem::path& outFile)
+{
+	WavWriter writer(outFile, sampleRate);
+	std::vector<Sample> queued(4096);
+	std::vector<float> mixed(queued.size());
+	std::vector<Sample> pcm(queued.size());
+	auto Flush = [&]()
+	{
+		size_t count = nes.apu->DrainSamples(queued.data(), queued.size());
+		for (size_t i = 0; i < count; i++)
+			mixed[i] = (float)queued[i] / Apu::SAMPLE_ONE;
+		AudioMixer::ConvertToPcm16(mixed.data(), pcm.data(), (int)count);
+		if (!writer.Write(pcm.data(), count))
+			throw EmuFileException("failed to write wav file");
+	};
+
+	Apu::SetSampleRate(sampleRate);
+	StartTrack(track);
+
+	// Call play at the requested rate, skipping a call if the last one
+	// has not returned yet
+	const double playPeriod = nsf.playPeriodUs * CPU_FREQUENCY / 1000000.0;
+	const long long totalCycles = (long long)(seconds * CPU_FREQUENCY);
+	double nextPlay = 0.0;
+	for (long long cycle = 0; cycle < totalCycles; cycle++)
+	{
+		if (cycle >= nextPlay)
+		{
+			if (RoutineFinished())
+				CallRoutine(nsf.playAddr);
+			nextPlay += playPeriod;
+		}
+		ClockCpu();
+
+		if ((cycle & 0x3FF) == 0)
+			Flush();
+	}
+	// Hands over the samples still gathered into a chunk
+	nes.apu->SetSynthesisEnabled(false);
+	Flush();
+	writer.Close();
+}
+
+void NsfPlayer::StartTrack(int track)
+{
+	nes.ram.Fill(0);
+	nes.cart->Reset();
+	nes.apu = std::make_shared<Apu>(nes);
+
+	// Initialise the apu as the nsf spec requires
+	for (uint16_t addr = 0x4000; addr <= 0x4013; addr++)
+		nes.CpuWrite(addr, 0x00);
+	nes.CpuWrite(0x4015, 0x00);
+	nes.CpuWrite(0x4015, 0x0F);
+	nes.CpuWrite(0x4017, 0x40);
+
+	nes.cpu->sp = 0xFD;
+	nes.cpu->status.reg = 0x24;
+	nes.cpu->ra = (uint8_t)track;
+	nes.cpu->rx = 0; // NTSC
+	nes.cpu->ry = 0;
+	CallRoutine(nsf.initAddr);
+
+	for (int i = 0; i < INIT_TIMEOUT_CYCLES && !RoutineFinished(); i++)
+		ClockCpu();
+}
+
+void NsfPlayer::CallRoutine(uint16_t addr)
+{
+	// Same as jsr, rts adds one to the popped address
+	uint16_t ret = RETURN_ADDR - 1;
+	nes.cpu->WriteStack(ret >> 8);
+	nes.cpu->WriteStack(ret & 0xFF);
+	nes.cpu->pc = addr;
+	nes.cpu->cyclesToNextInstruction = 0;
+}
+
+bool NsfPlayer::RoutineFinished() const
+{
+	return nes.cpu->InstructionComplete() && nes.cpu->pc == RETURN_ADDR;
+}
+
+void NsfPlayer::ClockCpu()
+{
+	// The apu is clocked by the ppu dot clock, three times per cpu cycle.
+	// The cpu idles between routines.
+	for (int i = 0; i < 3; i++)
+		nes.apu->Clock();
+	if (!RoutineFinished())
+		nes.cpu->Clock();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include "Nes.h"
+#include "NsfFile.h"
+
+// Renders nsf tracks to wav files as fast as possible. Only the cpu and apu
+// are emulated; no ppu is created.
+class NsfPlayer
+{
+public:
+	NsfPlayer(const std::wstring& filename, int sampleRate = AudioSink::DEFAULT_SAMPLE_RATE);
+	NsfPlayer(const NsfPlayer&) = delete;
+	NsfPlayer& operator=(const NsfPlayer&) = delete;
+	const NsfFile& GetFile() const;
+	// Track is zero based
+	void RenderTrack(int track, float seconds, const std::filesystem::path& outFile);
+	// The cpu runs at a third of the dot rate the apu samples against, so
+	// that a second of cycles gives a second of samples
+	static constexpr double CPU_FREQUENCY = Apu::DOT_RATE_X2 / 6.0;
+private:
+	void StartTrack(int track);
+	void CallRoutine(uint16_t addr);
+	bool RoutineFinished() const;
+	void ClockCpu();
+
+	// Routines return here, which is never executed
+	static constexpr uint16_t RETURN_ADDR = 0x5FF0;
+	static constexpr int INIT_TIMEOUT_CYCLES = (int)CPU_FREQUENCY;
+
+	NsfFile nsf;
+	Nes nes;
+	int sampleRate;
+};